@@ -17,6 +17,7 @@ using LuaCSFunction = XLua.LuaDLL.lua_CSFunction;
 #endif
 
 using System;
+using System.Runtime.InteropServices;
 
 namespace XLua
 {
@@ -141,6 +142,63 @@ namespace XLua
             return true;
         }
 
+        // for arrays of float vectors (Vector2/3/4, Quaternion, Color...), one native call for the whole array
+        public static bool PackArray(RealStatePtr L, Array array, int components, int meta_ref)
+        {
+            GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+            try
+            {
+                return LuaAPI.xlua_pushstructarray(L, handle.AddrOfPinnedObject(), array.Length, components,
+                    Marshal.SizeOf(array.GetType().GetElementType()), meta_ref);
+            }
+            finally
+            {
+                handle.Free();
+            }
+        }
+        // returns how many elements were unpacked, the rest (e.g. plain lua tables) needs the per-element path
+        public static int UnPackArray(RealStatePtr L, int idx, Array array, int components, int meta_ref)
+        {
+            GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+            try
+            {
+                return LuaAPI.xlua_tostructarray(L, idx, handle.AddrOfPinnedObject(), array.Length, components,
+                    Marshal.SizeOf(array.GetType().GetElementType()), meta_ref);
+            }
+            finally
+            {
+                handle.Free();
+            }
+        }
+        // same vectors as one flat lua table of numbers {x1, y1, z1, x2, ...}
+        public static bool PackFloatArray(RealStatePtr L, Array array, int components)
+        {
+            GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+            try
+            {
+                return LuaAPI.xlua_pushfloatarray(L, handle.AddrOfPinnedObject(), array.Length, components,
+                    Marshal.SizeOf(array.GetType().GetElementType()));
+            }
+            finally
+            {
+                handle.Free();
+            }
+        }
+        // returns how many complete vectors were read from the flat number table
+        public static int UnPackFloatArray(RealStatePtr L, int idx, Array array, int components)
+        {
+            GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+            try
+            {
+                return LuaAPI.xlua_tofloatarray(L, idx, handle.AddrOfPinnedObject(), array.Length, components,
+                    Marshal.SizeOf(array.GetType().GetElementType()));
+            }
+            finally
+            {
+                handle.Free();
+            }
+        }
+
         public static bool IsStruct(Type type)
         {
             return type.IsValueType() && !type.IsEnum() && !type.IsPrimitive();
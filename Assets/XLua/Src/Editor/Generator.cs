@@ -977,7 +977,8 @@ namespace CSObjectWrapEditor
                          Type = t,
                          Size = SizeOf(t),
                          Flag = t.IsEnum ? OptimizeFlag.Default : OptimizeCfg[t],
-                         FieldInfos = (t.IsEnum || OptimizeCfg[t] == OptimizeFlag.Default) ? null : getXluaTypeInfo(t, emptyMap).FieldInfos
+                         FieldInfos = (t.IsEnum || OptimizeCfg[t] == OptimizeFlag.Default) ? null : getXluaTypeInfo(t, emptyMap).FieldInfos,
+                         VectorComponents = (t.IsEnum || OptimizeCfg[t] == OptimizeFlag.PackAsTable) ? 0 : floatVectorComponents(t)
                      }).ToList());
                 type_info.Set("tableoptimzetypes", types.Where(t => !t.IsEnum && SizeOf(t) == -1)
                      .Select(t => new { Type = t, Fields = t.GetFields(BindingFlags.Public | BindingFlags.Instance | BindingFlags.DeclaredOnly) })
@@ -1246,6 +1247,22 @@ namespace CSObjectWrapEditor
             return new XluaTypeInfo { Type = t, FieldInfos = fs.ToList(), FieldGroup = grouped_field, IsRoot = set.ContainsKey(t) };
         }
 
+        // 只由float字段组成并且内存布局和打包布局一致(Vector3, Quaternion, Color...)的struct，数组可以整块拷贝，返回分量个数，否则返回0
+        static int floatVectorComponents(Type t)
+        {
+            if (t.IsEnum || !t.IsValueType || t.IsGenericType || t.IsExplicitLayout)
+            {
+                return 0;
+            }
+            var type_info = getXluaTypeInfo(t, new Dictionary<Type, Type>());
+            if (type_info.FieldGroup == null || type_info.FieldGroup.Count != 1 || type_info.FieldInfos.Any(fi => !fi.IsField))
+            {
+                return 0;
+            }
+            int components = type_info.FieldInfos.Count;
+            return System.Runtime.InteropServices.Marshal.SizeOf(t) == components * sizeof(float) ? components : 0;
+        }
+
         public static void GenPackUnpack(IEnumerable<Type> types, string save_path)
         {
             var set = types.ToDictionary(type => type);
@@ -0,0 +1,118 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making xLua available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+*/
+
+using System;
+using System.Collections.Generic;
+
+namespace XLua
+{
+    // 枚举值缓存：每个枚举类型第一次用到时注册一次，记下底层类型并把定义的值装箱保存。
+    // push时按底层类型拆箱，不经过Convert.ToInt64（它会再装箱一次）；Lua传回的整数直接取缓存的枚举对象，不再每次Enum.ToObject
+    public class EnumValueCache
+    {
+        // 0到SMALL_LIMIT-1之间的值放数组，其余定义值放字典
+        const int SMALL_LIMIT = 1024;
+
+        class EnumValues
+        {
+            public TypeCode typeCode;
+            public object[] small;
+            public Dictionary<long, object> others = new Dictionary<long, object>();
+        }
+
+        Dictionary<Type, EnumValues> cache = new Dictionary<Type, EnumValues>();
+
+        EnumValues getValues(Type type)
+        {
+            EnumValues values;
+            if (cache.TryGetValue(type, out values))
+            {
+                return values;
+            }
+
+            values = new EnumValues();
+            values.typeCode = Type.GetTypeCode(Enum.GetUnderlyingType(type));
+            Array defined = Enum.GetValues(type);
+            long max_small = -1;
+            foreach (object o in defined)
+            {
+                long v = toInt64(o, values.typeCode);
+                if (v >= 0 && v < SMALL_LIMIT && v > max_small)
+                {
+                    max_small = v;
+                }
+            }
+            values.small = new object[max_small + 1];
+            foreach (object o in defined)
+            {
+                long v = toInt64(o, values.typeCode);
+                if (v >= 0 && v <= max_small)
+                {
+                    if (values.small[v] == null) values.small[v] = o;
+                }
+                else if (!values.others.ContainsKey(v))
+                {
+                    values.others.Add(v, o);
+                }
+            }
+            cache.Add(type, values);
+            return values;
+        }
+
+        static long toInt64(object o, TypeCode typeCode)
+        {
+            switch (typeCode)
+            {
+                case TypeCode.SByte:
+                    return (sbyte)o;
+                case TypeCode.Byte:
+                    return (byte)o;
+                case TypeCode.Int16:
+                    return (short)o;
+                case TypeCode.UInt16:
+                    return (ushort)o;
+                case TypeCode.Int32:
+                    return (int)o;
+                case TypeCode.UInt32:
+                    return (uint)o;
+                case TypeCode.Int64:
+                    return (long)o;
+                case TypeCode.UInt64:
+                    return (long)(ulong)o;
+                default:
+                    return Convert.ToInt64(o);
+            }
+        }
+
+        // o必须是type类型的装箱枚举值
+        public long ToInt64(object o, Type type)
+        {
+            return toInt64(o, getValues(type).typeCode);
+        }
+
+        public object ToObject(Type type, long v)
+        {
+            EnumValues values = getValues(type);
+            object o;
+            if (v >= 0 && v < values.small.Length)
+            {
+                o = values.small[v];
+                if (o != null)
+                {
+                    return o;
+                }
+            }
+            else if (values.others.TryGetValue(v, out o))
+            {
+                return o;
+            }
+            // 未定义的值（例如Flags组合）不缓存，避免缓存无限增长
+            return Enum.ToObject(type, v);
+        }
+    }
+}
@@ -89,6 +89,18 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
 		public static extern IntPtr luaL_newstate();
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+		public static extern IntPtr xlua_newstate();//luaL_newstate on a per state slab allocator
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+		public static extern int xlua_alloc_class_count();
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+		public static extern bool xlua_alloc_stats(IntPtr L, int cls, out uint block_size, out ulong live_bytes, out ulong live_blocks, out ulong reserved_bytes);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+		public static extern bool xlua_memstats(IntPtr L, int tag, out ulong live_bytes, out ulong live_blocks);//tag: MEM_* in slab_alloc.h
+
 		[DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
 		public static extern void lua_close(IntPtr L);
 
@@ -234,6 +246,12 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern uint xlua_touint(IntPtr L, int index);
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_pushenum(IntPtr L, long n);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool xlua_toenum(IntPtr L, int index, out long n);
+
         [DllImport(LUADLL,CallingConvention=CallingConvention.Cdecl)]
 		public static extern bool lua_toboolean(IntPtr L, int index);
 
@@ -322,6 +340,18 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern void xlua_pushlstring(IntPtr L, byte[] str, int size);
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_stringhandle(IntPtr L, byte[] str, int size);
+
+        public static int xlua_stringhandle(IntPtr L, string str)
+        {
+            byte[] bytes = Encoding.UTF8.GetBytes(str);
+            return xlua_stringhandle(L, bytes, bytes.Length);
+        }
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_pushstringhandle(IntPtr L, int handle);
+
         public static void xlua_pushasciistring(IntPtr L, string str) // for inner use only
         {
             if (str == null)
@@ -435,6 +465,18 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern void xlua_pushcsobj(IntPtr L, int key, int meta_ref, bool need_cache, int cache_ref);//[-0, +1, m]
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_new_csobj_handles(IntPtr L);//[-0, +0, m]
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_tryget_csobj(IntPtr L, IntPtr handles, int key);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_pushcsobj_handle(IntPtr L, IntPtr handles, int key, int meta_ref, bool need_cache);//[-0, +1, m]
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_release_csobj(IntPtr L, IntPtr handles, int index);
+
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]//[,,m]
         public static extern int gen_obj_indexer(IntPtr L);
 
@@ -539,6 +581,15 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern int xlua_psettable_bypath(IntPtr L, int idx, string path);
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_compile_path(IntPtr L, string path);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_pgettable_bypathref(IntPtr L, int idx, int path_ref);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_psettable_bypathref(IntPtr L, int idx, int path_ref);
+
         #region SidlRT扩展
 
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
@@ -552,6 +603,30 @@ namespace XLua.LuaDLL
 
         #endregion
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_indexer_cache_invalidate();
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_indexer_cache_stats(out ulong hits, out ulong misses, bool reset);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_set_flatten_indexers(bool enable);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_pushtypedarray(IntPtr L, int type, IntPtr src, uint len);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_pushtypedarrayview(IntPtr L, int type, IntPtr data, uint len);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_totypedarray(IntPtr L, int idx, out int type, out uint len);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_typedarray_copyto(IntPtr L, int idx, int type, IntPtr dst, uint len);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_typedarray_detach(IntPtr L, int idx);
+
         //[DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         //public static extern void xlua_pushbuffer(IntPtr L, byte[] buff);
 
@@ -577,6 +652,16 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern bool xlua_unpack_float6(IntPtr buff, int offset, out float f1, out float f2, out float f3, out float f4, out float f5, out float f6);
 
+        //batched version of xlua_pack_floatN/xlua_unpack_floatN for a pinned array of count vectors, stride bytes apart
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool xlua_pushstructarray(IntPtr L, IntPtr src, int count, int components, int stride, int meta_ref);
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_tostructarray(IntPtr L, int idx, IntPtr dst, int count, int components, int stride, int meta_ref);
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool xlua_pushfloatarray(IntPtr L, IntPtr src, int count, int components, int stride);
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_tofloatarray(IntPtr L, int idx, IntPtr dst, int count, int components, int stride);
+
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern bool xlua_pack_decimal(IntPtr buff, int offset, ref decimal dec);
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
@@ -590,6 +675,19 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern bool xlua_is_eq_str(IntPtr L, int index, string str, int str_len);
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_tostringview(IntPtr L, int index, out int len, out uint hash);
+
+        // 不是string（包括number）返回false，view.IsNull为true
+        public static bool xlua_tostringview(IntPtr L, int index, out LuaStringView view)
+        {
+            int len;
+            uint hash;
+            IntPtr data = xlua_tostringview(L, index, out len, out hash);
+            view = new LuaStringView(data, len, hash);
+            return data != IntPtr.Zero;
+        }
+
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern IntPtr xlua_gl(IntPtr L);
 
@@ -600,10 +698,13 @@ namespace XLua.LuaDLL
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern void xlua_push_csharp_wrapper(IntPtr L, int wrapperID);
 
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_push_csharp_wrapper_direct(IntPtr L, IntPtr wrapper);
+
         public static void xlua_set_csharp_wrapper_caller(CSharpWrapperCaller wrapper_caller)
         {
 #if XLUA_GENERAL || (UNITY_WSA && !UNITY_EDITOR)
-            GCHandle.Alloc(wrapper);
+            GCHandle.Alloc(wrapper_caller);
 #endif
             xlua_set_csharp_wrapper_caller(Marshal.GetFunctionPointerForDelegate(wrapper_caller));
         }
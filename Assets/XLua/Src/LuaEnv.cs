@@ -76,9 +76,16 @@ namespace XLua
                 LuaIndexes.LUA_REGISTRYINDEX = LuaAPI.xlua_get_registry_index();
 #if GEN_CODE_MINIMIZE
                 LuaAPI.xlua_set_csharp_wrapper_caller(InternalGlobals.CSharpWrapperCallerPtr);
+#endif
+#if XLUA_FLATTEN_INDEXERS
+                LuaAPI.xlua_set_flatten_indexers(true);
 #endif
                 // Create State
+#if XLUA_DEFAULT_ALLOCATOR
                 rawL = LuaAPI.luaL_newstate();
+#else
+                rawL = LuaAPI.xlua_newstate();
+#endif
 
                 //Init Base Libs
                 LuaAPI.luaopen_xlua(rawL);
@@ -363,6 +370,37 @@ namespace XLua
             Tick();
         }
 
+        // 注册一个会反复push的字符串（字段名、事件名、本地化key等），之后用LuaAPI.xlua_pushstringhandle按返回的句柄push，
+        // 不再做UTF-8编码和lua的hash/intern；同一个字符串注册多次得到同一个句柄，句柄在LuaEnv存活期间一直有效
+        public int RegisterString(string str)
+        {
+            if (str == null)
+            {
+                throw new ArgumentNullException("str");
+            }
+#if THREAD_SAFE || HOTFIX_ENABLE
+            lock (luaEnvLock)
+            {
+#endif
+                return LuaAPI.xlua_stringhandle(L, str);
+#if THREAD_SAFE || HOTFIX_ENABLE
+            }
+#endif
+        }
+
+        // 预编译GetInPath/SetInPath用的路径，每帧访问的配置路径只需拆分一次
+        public LuaPath CompilePath(string path)
+        {
+#if THREAD_SAFE || HOTFIX_ENABLE
+            lock (luaEnvLock)
+            {
+#endif
+                return new LuaPath(LuaAPI.xlua_compile_path(L, path), this, path);
+#if THREAD_SAFE || HOTFIX_ENABLE
+            }
+#endif
+        }
+
         public LuaTable NewTable()
         {
 #if THREAD_SAFE || HOTFIX_ENABLE
@@ -0,0 +1,42 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making xLua available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+*/
+
+#if USE_UNI_LUA
+using LuaAPI = UniLua.Lua;
+using RealStatePtr = UniLua.ILuaState;
+using LuaCSFunction = UniLua.CSharpFunctionDelegate;
+#else
+using LuaAPI = XLua.LuaDLL.Lua;
+using RealStatePtr = System.IntPtr;
+using LuaCSFunction = XLua.LuaDLL.lua_CSFunction;
+#endif
+
+using System;
+
+namespace XLua
+{
+    // LuaEnv.CompilePath返回，路径的每一段只在编译时拆分和intern一次
+    public class LuaPath : LuaBase
+    {
+        public readonly string Path;
+
+        public LuaPath(int reference, LuaEnv luaenv, string path) : base(reference, luaenv)
+        {
+            Path = path;
+        }
+
+        internal int Reference { get { return luaReference; } }
+
+        internal LuaEnv Env { get { return luaEnv; } }
+
+        public override string ToString()
+        {
+            return Path;
+        }
+    }
+}
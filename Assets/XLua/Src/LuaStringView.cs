@@ -0,0 +1,161 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making xLua available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and limitations under the License.
+*/
+
+using System;
+using System.Runtime.InteropServices;
+using System.Text;
+
+namespace XLua
+{
+    // lua字符串的只读视图，由LuaAPI.xlua_tostringview取得：直接指向lua的字符串内存，只在该值被引用（在栈上或者table里）期间有效。
+    // 比较、求hash不产生托管对象，Hash是UTF-8字节的FNV-1a，可以用LuaStringView.ComputeHash预先算好C#侧的key
+    public struct LuaStringView
+    {
+        public readonly IntPtr Data;
+        public readonly int Length;
+        public readonly uint Hash;
+
+        public LuaStringView(IntPtr data, int length, uint hash)
+        {
+            Data = data;
+            Length = length;
+            Hash = hash;
+        }
+
+        public bool IsNull { get { return Data == IntPtr.Zero; } }
+
+        public byte this[int index]
+        {
+            get
+            {
+                if ((uint)index >= (uint)Length)
+                {
+                    throw new IndexOutOfRangeException();
+                }
+                return Marshal.ReadByte(Data, index);
+            }
+        }
+
+        public bool Equals(byte[] utf8)
+        {
+            return utf8 != null && utf8.Length == Length && matchAt(utf8, 0);
+        }
+
+        public bool StartsWith(byte[] utf8)
+        {
+            return utf8 != null && utf8.Length <= Length && matchAt(utf8, 0);
+        }
+
+        public bool EndsWith(byte[] utf8)
+        {
+            return utf8 != null && utf8.Length <= Length && matchAt(utf8, Length - utf8.Length);
+        }
+
+        // 按UTF-8逐字节比较，不编码出byte[]
+        public bool Equals(string str)
+        {
+            if (str == null || IsNull)
+            {
+                return false;
+            }
+            int pos = 0;
+            for (int i = 0; i < str.Length; i++)
+            {
+                int count;
+                uint bytes = utf8Bytes(str, ref i, out count);
+                for (; count > 0; count--, bytes >>= 8)
+                {
+                    if (pos >= Length || Marshal.ReadByte(Data, pos++) != (byte)bytes)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return pos == Length;
+        }
+
+        public override string ToString()
+        {
+            if (IsNull)
+            {
+                return null;
+            }
+            byte[] buffer = new byte[Length];
+            Marshal.Copy(Data, buffer, 0, Length);
+            return Encoding.UTF8.GetString(buffer);
+        }
+
+        public static uint ComputeHash(byte[] utf8)
+        {
+            uint h = 2166136261;
+            for (int i = 0; i < utf8.Length; i++)
+            {
+                h = (h ^ utf8[i]) * 16777619;
+            }
+            return h;
+        }
+
+        // 和ComputeHash(Encoding.UTF8.GetBytes(str))一致
+        public static uint ComputeHash(string str)
+        {
+            uint h = 2166136261;
+            for (int i = 0; i < str.Length; i++)
+            {
+                int count;
+                uint bytes = utf8Bytes(str, ref i, out count);
+                for (; count > 0; count--, bytes >>= 8)
+                {
+                    h = (h ^ (bytes & 0xFF)) * 16777619;
+                }
+            }
+            return h;
+        }
+
+        bool matchAt(byte[] utf8, int offset)
+        {
+            for (int i = 0; i < utf8.Length; i++)
+            {
+                if (Marshal.ReadByte(Data, offset + i) != utf8[i])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // str[i]的UTF-8编码，首字节在最低位，count返回字节数(U+0000编码成一个0字节，不能靠非0判断结束)；
+        // 代理对会让i多前进一位，落单的代理项和Encoding.UTF8一样编码成U+FFFD
+        static uint utf8Bytes(string str, ref int i, out int count)
+        {
+            int c = str[i];
+            if (c < 0x80)
+            {
+                count = 1;
+                return (uint)c;
+            }
+            if (c < 0x800)
+            {
+                count = 2;
+                return (uint)(0xC0 | (c >> 6)) | ((uint)(0x80 | (c & 0x3F)) << 8);
+            }
+            if (c >= 0xD800 && c <= 0xDFFF)
+            {
+                if (c <= 0xDBFF && i + 1 < str.Length && str[i + 1] >= 0xDC00 && str[i + 1] <= 0xDFFF)
+                {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (str[++i] - 0xDC00);
+                    count = 4;
+                    return (uint)(0xF0 | (c >> 18)) | ((uint)(0x80 | ((c >> 12) & 0x3F)) << 8)
+                        | ((uint)(0x80 | ((c >> 6) & 0x3F)) << 16) | ((uint)(0x80 | (c & 0x3F)) << 24);
+                }
+                c = 0xFFFD;
+            }
+            count = 3;
+            return (uint)(0xE0 | (c >> 12)) | ((uint)(0x80 | ((c >> 6) & 0x3F)) << 8) | ((uint)(0x80 | (c & 0x3F)) << 16);
+        }
+    }
+}
@@ -190,6 +190,70 @@ namespace XLua
 #endif
         }
 
+        public T GetInPath<T>(LuaPath path)
+        {
+#if THREAD_SAFE || HOTFIX_ENABLE
+            lock (luaEnv.luaEnvLock)
+            {
+#endif
+                if (path.Env != luaEnv)
+                {
+                    throw new ArgumentException("path compiled by another LuaEnv: " + path);
+                }
+                var L = luaEnv.L;
+                var translator = luaEnv.translator;
+                int oldTop = LuaAPI.lua_gettop(L);
+                LuaAPI.lua_getref(L, luaReference);
+                if (0 != LuaAPI.xlua_pgettable_bypathref(L, -1, path.Reference))
+                {
+                    luaEnv.ThrowExceptionFromError(oldTop);
+                }
+                LuaTypes lua_type = LuaAPI.lua_type(L, -1);
+                if (lua_type == LuaTypes.LUA_TNIL && typeof(T).IsValueType())
+                {
+                    throw new InvalidCastException("can not assign nil to " + typeof(T).GetFriendlyName());
+                }
+
+                T value;
+                try
+                {
+                    translator.Get(L, -1, out value);
+                }
+                finally
+                {
+                    LuaAPI.lua_settop(L, oldTop);
+                }
+                return value;
+#if THREAD_SAFE || HOTFIX_ENABLE
+            }
+#endif
+        }
+
+        public void SetInPath<T>(LuaPath path, T val)
+        {
+#if THREAD_SAFE || HOTFIX_ENABLE
+            lock (luaEnv.luaEnvLock)
+            {
+#endif
+                if (path.Env != luaEnv)
+                {
+                    throw new ArgumentException("path compiled by another LuaEnv: " + path);
+                }
+                var L = luaEnv.L;
+                int oldTop = LuaAPI.lua_gettop(L);
+                LuaAPI.lua_getref(L, luaReference);
+                luaEnv.translator.PushByType(L, val);
+                if (0 != LuaAPI.xlua_psettable_bypathref(L, -2, path.Reference))
+                {
+                    luaEnv.ThrowExceptionFromError(oldTop);
+                }
+
+                LuaAPI.lua_settop(L, oldTop);
+#if THREAD_SAFE || HOTFIX_ENABLE
+            }
+#endif
+        }
+
         [Obsolete("use no boxing version: GetInPath/SetInPath Get/Set instead!")]
         public object this[string field]
         {
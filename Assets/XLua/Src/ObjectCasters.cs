@@ -144,7 +144,8 @@ namespace XLua
                 // return fixTypeCheck;
                 return (RealStatePtr L, int idx) =>
                 {
-                    return LuaAPI.lua_type(L, idx) == LuaTypes.LUA_TNUMBER && (LuaAPI.lua_isint64(L, idx) || LuaAPI.lua_isinteger(L, idx));
+                    long enum_value;
+                    return LuaAPI.xlua_toenum(L, idx, out enum_value);
                 };
             }
             else if (type.IsInterface())
@@ -501,16 +502,10 @@ namespace XLua
                     //{
                     //    return Enum.ToObject(type, LuaAPI.xlua_tointeger(L, idx));
                     //}
-                    if (type.IsEnum() && LuaAPI.lua_type(L, idx) == LuaTypes.LUA_TNUMBER)
+                    long enum_value;
+                    if (LuaAPI.xlua_toenum(L, idx, out enum_value))
                     {
-                        if (LuaAPI.lua_isint64(L, idx))
-                        {
-                            return Enum.ToObject(type, LuaAPI.lua_toint64(L, idx));
-                        }
-                        else if (LuaAPI.lua_isinteger(L, idx))
-                        {
-                            return Enum.ToObject(type, LuaAPI.xlua_tointeger(L, idx));
-                        }
+                        return translator.enumValues.ToObject(type, enum_value);
                     }
                     throw new InvalidCastException("invalid value for enum " + type);
                 };
@@ -537,7 +532,15 @@ namespace XLua
                     {
                         throw new Exception("stack overflow while cast to Array");
                     }
-                    for (int i = 0; i < len; ++i)
+                    int start = 0;
+                    int components = translator.GetFloatVectorComponents(et);
+                    if (components > 0)
+                    {
+                        // Vector3之类的struct userdata一次拷完，遇到第一个不是的元素再走逐个转换
+                        bool is_first;
+                        start = CopyByValue.UnPackArray(L, idx, ary, components, translator.getTypeId(L, et, out is_first));
+                    }
+                    for (int i = start; i < len; ++i)
                     {
                         LuaAPI.lua_pushnumber(L, i + 1);
                         LuaAPI.lua_rawget(L, idx);
@@ -24,6 +24,7 @@ namespace XLua
     using System.Reflection;
     using System.Collections.Generic;
     using System.Diagnostics;
+    using System.Runtime.InteropServices;
     using System.Linq;
 
     class ReferenceEqualsComparer : IEqualityComparer<object>
@@ -99,6 +100,7 @@ namespace XLua
     }
 
 #if GEN_CODE_MINIMIZE
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
     public delegate int CSharpWrapper(IntPtr L, int top);
 #endif
 
@@ -109,6 +111,7 @@ namespace XLua
         internal ObjectCasters objectCasters;
 
         internal readonly ObjectPool objects = new ObjectPool();
+        internal readonly EnumValueCache enumValues = new EnumValueCache();
         internal readonly Dictionary<object, int> reverseMap = new Dictionary<object, int>(new ReferenceEqualsComparer());
 		internal LuaEnv luaEnv;
 		internal StaticLuaCallbacks metaFunctions;
@@ -202,7 +205,8 @@ namespace XLua
             aliasCfg[alias_type] = type;
         }
 
-        public int cacheRef;
+        // xlua.c的C#对象句柄表：缓存userdata，并记录每个index当前userdata的代数
+        internal IntPtr objHandles;
 
         void addAssemblieByName(IEnumerable<Assembly> assemblies_usorted, string name)
         {
@@ -254,13 +258,7 @@ namespace XLua
             loadAssemblyFunction = new LuaCSFunction(StaticLuaCallbacks.LoadAssembly);
             castFunction = new LuaCSFunction(StaticLuaCallbacks.Cast);
 
-            LuaAPI.lua_newtable(L);
-            LuaAPI.lua_newtable(L);
-            LuaAPI.xlua_pushasciistring(L, "__mode");
-            LuaAPI.xlua_pushasciistring(L, "v");
-            LuaAPI.lua_rawset(L, -3);
-            LuaAPI.lua_setmetatable(L, -2);
-            cacheRef = LuaAPI.luaL_ref(L, LuaIndexes.LUA_REGISTRYINDEX);
+            objHandles = LuaAPI.xlua_new_csobj_handles(L);
 
             initCSharpCallLua();
         }
@@ -707,6 +705,21 @@ namespace XLua
             LuaAPI.xlua_pushasciistring(L, "release");
             LuaAPI.lua_pushstdcallcfunction(L, StaticLuaCallbacks.ReleaseCsObject);
             LuaAPI.lua_rawset(L, -3);
+            LuaAPI.xlua_pushasciistring(L, "to_typed_array");
+            LuaAPI.lua_pushstdcallcfunction(L, StaticLuaCallbacks.ToTypedArray);
+            LuaAPI.lua_rawset(L, -3);
+            LuaAPI.xlua_pushasciistring(L, "copy_typed_array");
+            LuaAPI.lua_pushstdcallcfunction(L, StaticLuaCallbacks.CopyTypedArray);
+            LuaAPI.lua_rawset(L, -3);
+            LuaAPI.xlua_pushasciistring(L, "to_struct_table");
+            LuaAPI.lua_pushstdcallcfunction(L, StaticLuaCallbacks.ToStructTable);
+            LuaAPI.lua_rawset(L, -3);
+            LuaAPI.xlua_pushasciistring(L, "to_float_table");
+            LuaAPI.lua_pushstdcallcfunction(L, StaticLuaCallbacks.ToFloatTable);
+            LuaAPI.lua_rawset(L, -3);
+            LuaAPI.xlua_pushasciistring(L, "copy_float_table");
+            LuaAPI.lua_pushstdcallcfunction(L, StaticLuaCallbacks.CopyFloatTable);
+            LuaAPI.lua_rawset(L, -3);
             LuaAPI.lua_pop(L, 1);
 
             LuaAPI.lua_createtable(L, 1, 4); // 4 for __gc, __tostring, __index, __newindex
@@ -911,16 +924,10 @@ namespace XLua
                         return SidlRT.SidlObjectHandlePool.GetDynamic(instanceId);
                     }
                 }
-                if (type.IsEnum() && lua_type == LuaTypes.LUA_TNUMBER)
+                long enum_value;
+                if (type.IsEnum() && LuaAPI.xlua_toenum(L, index, out enum_value))
                 {
-                    if (LuaAPI.lua_isint64(L, index))
-                    {
-                        return Enum.ToObject(type, LuaAPI.lua_toint64(L, index));
-                    }
-                    else if (LuaAPI.lua_isinteger(L, index))
-                    {
-                        return Enum.ToObject(type, LuaAPI.xlua_tointeger(L, index));
-                    }
+                    return enumValues.ToObject(type, enum_value);
                 }
                 return (objectCasters.GetCaster(type)(L, index, null));
             }
@@ -1180,8 +1187,8 @@ namespace XLua
             }
             else if(type.IsEnum())
             {
-                // 枚举对象全部转换为64位整型值，不作为object对象
-                LuaAPI.lua_pushint64(L, Convert.ToInt64(o));
+                // 枚举对象全部转换为整型值，不作为object对象
+                LuaAPI.xlua_pushenum(L, enumValues.ToInt64(o, type));
             }
             else if (type == typeof(byte[]))
             {
@@ -1287,7 +1294,7 @@ namespace XLua
             Type type = o.GetType();
             if (type.IsEnum())
             {
-                LuaAPI.lua_pushint64(L, Convert.ToInt64(o));
+                LuaAPI.xlua_pushenum(L, enumValues.ToInt64(o, type));
                 return;
             }
 
@@ -1302,12 +1309,12 @@ namespace XLua
             bool needcache = !is_valuetype || is_enum;
             if (needcache && (is_enum ? enumMap.TryGetValue(o, out index) : reverseMap.TryGetValue(o, out index)))
             {
-                if (LuaAPI.xlua_tryget_cachedud(L, index, cacheRef) == 1)
+                if (LuaAPI.xlua_tryget_csobj(L, objHandles, index) == 1)
                 {
                     return;
                 }
-                //这里实在太经典了，weaktable先删除，然后GC会延迟调用，当index会循环利用的时候，不注释这行将会导致重复释放
-                //collectObject(index);
+                //weaktable先删除，然后GC会延迟调用。旧userdata的代数已失效，它的__gc不会再释放这个index，所以可以马上回收
+                collectObject(index);
             }
 
             bool is_first;
@@ -1316,14 +1323,15 @@ namespace XLua
             //如果一个type的定义含本身静态readonly实例时，getTypeId会push一个实例，这时候应该用这个实例
             if (is_first && needcache && (is_enum ? enumMap.TryGetValue(o, out index) : reverseMap.TryGetValue(o, out index))) 
             {
-                if (LuaAPI.xlua_tryget_cachedud(L, index, cacheRef) == 1)
+                if (LuaAPI.xlua_tryget_csobj(L, objHandles, index) == 1)
                 {
                     return;
                 }
+                collectObject(index);
             }
 
             index = addObject(o, is_valuetype, is_enum);
-            LuaAPI.xlua_pushcsobj(L, index, type_id, needcache, cacheRef);
+            LuaAPI.xlua_pushcsobj_handle(L, objHandles, index, type_id, needcache);
         }
 
         public void PushObject(RealStatePtr L, object o, int type_id)
@@ -1337,15 +1345,16 @@ namespace XLua
             int index = -1;
             if (reverseMap.TryGetValue(o, out index))
             {
-                if (LuaAPI.xlua_tryget_cachedud(L, index, cacheRef) == 1)
+                if (LuaAPI.xlua_tryget_csobj(L, objHandles, index) == 1)
                 {
                     return;
                 }
+                collectObject(index);
             }
 
             index = addObject(o, false, false);
 
-            LuaAPI.xlua_pushcsobj(L, index, type_id, true, cacheRef);
+            LuaAPI.xlua_pushcsobj_handle(L, objHandles, index, type_id, true);
         }
 
         public void Update(RealStatePtr L, int index, object obj)
@@ -1494,7 +1503,25 @@ namespace XLua
             }
             else
             {
+#if XLUA_DIRECT_WRAPPER_CALL
+                // 委托的函数指针直接交给xlua.c，调用时不再经过CSharpWrapperCallerImpl；csharpWrapper数组负责让委托保持存活
+                // 生成代码里没有try/catch，这里和CSharpWrapperCallerImpl一样捕获异常，不能让C#异常穿过native栈帧
+                CSharpWrapper wrapped = func;
+                func = (IntPtr l, int top) =>
+                {
+                    try
+                    {
+                        return wrapped(l, top);
+                    }
+                    catch (Exception e)
+                    {
+                        return LuaAPI.luaL_error(l, "c# exception:" + e);
+                    }
+                };
+                LuaAPI.xlua_push_csharp_wrapper_direct(L, Marshal.GetFunctionPointerForDelegate(func));
+#else
                 LuaAPI.xlua_push_csharp_wrapper(L, csharpWrapperSize);
+#endif
                 ensureCSharpWrapperCapacity(csharpWrapperSize + 1);
                 csharpWrapper[csharpWrapperSize++] = func;
             }
@@ -1565,6 +1592,21 @@ namespace XLua
             return custom_push_funcs.ContainsKey(type);
         }
 
+        // 内存布局就是连续float的struct(由生成代码注册)，数组可以通过CopyByValue.PackArray/UnPackArray整块拷贝
+        private Dictionary<Type, int> float_vector_components = new Dictionary<Type, int>();
+
+        public void RegisterFloatVector(Type type, int components)
+        {
+            float_vector_components[type] = components;
+        }
+
+        // 返回struct的float分量个数，不是这类struct时返回0
+        internal int GetFloatVectorComponents(Type type)
+        {
+            int components;
+            return float_vector_components.TryGetValue(type, out components) ? components : 0;
+        }
+
         private Dictionary<Type, Delegate> push_func_with_type = null;
         
         bool tryGetPushFuncByType<T>(Type type, out T func) where T : class
@@ -21,6 +21,7 @@ namespace XLua
     using System;
     using System.IO;
     using System.Reflection;
+    using System.Runtime.InteropServices;
 
     public partial class StaticLuaCallbacks
     {
@@ -160,11 +161,11 @@ namespace XLua
         {
             try
             {
-                int udata = LuaAPI.xlua_tocsobj_safe(L, 1);
-                if (udata != -1)
+                ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
+                if (translator != null)
                 {
-                    ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
-                    if ( translator != null )
+                    int udata = LuaAPI.xlua_release_csobj(L, translator.objHandles, 1);
+                    if (udata != -1)
                     {
                         translator.collectObject(udata);
                     }
@@ -1236,5 +1237,168 @@ namespace XLua
                 return LuaAPI.luaL_error(L, "c# exception in ReleaseCsObject: " + e);
             }
         }
+
+        // element tag of build/xlua.c typed arrays (T_INT8..T_DOUBLE), -1 for unsupported element types
+        static int typedArrayTag(Array array)
+        {
+            if (array == null || array.Rank != 1)
+            {
+                return -1;
+            }
+            Type elementType = array.GetType().GetElementType();
+            if (elementType == typeof(sbyte)) return 0;
+            if (elementType == typeof(byte)) return 1;
+            if (elementType == typeof(short)) return 2;
+            if (elementType == typeof(ushort)) return 3;
+            if (elementType == typeof(int)) return 4;
+            if (elementType == typeof(uint)) return 5;
+            if (elementType == typeof(long)) return 6;
+            if (elementType == typeof(ulong)) return 7;
+            if (elementType == typeof(float)) return 8;
+            if (elementType == typeof(double)) return 9;
+            return -1;
+        }
+
+        [MonoPInvokeCallback(typeof(LuaCSFunction))]
+        public static int ToTypedArray(RealStatePtr L)
+        {
+            try
+            {
+                ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
+                Array array = translator.SafeGetCSObj(L, 1) as Array;
+                int tag = typedArrayTag(array);
+                if (tag == -1)
+                {
+                    return LuaAPI.luaL_error(L, "xlua.to_typed_array: #1 argument must be a one-dimensional primitive array");
+                }
+                GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+                try
+                {
+                    LuaAPI.xlua_pushtypedarray(L, tag, handle.AddrOfPinnedObject(), (uint)array.Length);
+                }
+                finally
+                {
+                    handle.Free();
+                }
+                return 1;
+            }
+            catch (Exception e)
+            {
+                return LuaAPI.luaL_error(L, "c# exception in xlua.to_typed_array: " + e);
+            }
+        }
+
+        [MonoPInvokeCallback(typeof(LuaCSFunction))]
+        public static int CopyTypedArray(RealStatePtr L)
+        {
+            try
+            {
+                ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
+                Array array = translator.SafeGetCSObj(L, 2) as Array;
+                int tag = typedArrayTag(array);
+                if (tag == -1)
+                {
+                    return LuaAPI.luaL_error(L, "xlua.copy_typed_array: #2 argument must be a one-dimensional primitive array");
+                }
+                int copied;
+                GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+                try
+                {
+                    copied = LuaAPI.xlua_typedarray_copyto(L, 1, tag, handle.AddrOfPinnedObject(), (uint)array.Length);
+                }
+                finally
+                {
+                    handle.Free();
+                }
+                if (copied == -1)
+                {
+                    return LuaAPI.luaL_error(L, "xlua.copy_typed_array: #1 argument must be a typed array of " + array.GetType().GetElementType());
+                }
+                LuaAPI.xlua_pushinteger(L, copied);
+                return 1;
+            }
+            catch (Exception e)
+            {
+                return LuaAPI.luaL_error(L, "c# exception in xlua.copy_typed_array: " + e);
+            }
+        }
+
+        // 元素是Vector3之类连续float布局的struct时返回分量个数，否则返回0
+        static int floatVectorComponents(ObjectTranslator translator, Array array)
+        {
+            if (array == null || array.Rank != 1)
+            {
+                return 0;
+            }
+            return translator.GetFloatVectorComponents(array.GetType().GetElementType());
+        }
+
+        [MonoPInvokeCallback(typeof(LuaCSFunction))]
+        public static int ToStructTable(RealStatePtr L)
+        {
+            try
+            {
+                ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
+                Array array = translator.SafeGetCSObj(L, 1) as Array;
+                int components = floatVectorComponents(translator, array);
+                if (components == 0)
+                {
+                    return LuaAPI.luaL_error(L, "xlua.to_struct_table: #1 argument must be a one-dimensional array of a GCOptimize float struct");
+                }
+                bool is_first;
+                CopyByValue.PackArray(L, array, components, translator.getTypeId(L, array.GetType().GetElementType(), out is_first));
+                return 1;
+            }
+            catch (Exception e)
+            {
+                return LuaAPI.luaL_error(L, "c# exception in xlua.to_struct_table: " + e);
+            }
+        }
+
+        [MonoPInvokeCallback(typeof(LuaCSFunction))]
+        public static int ToFloatTable(RealStatePtr L)
+        {
+            try
+            {
+                ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
+                Array array = translator.SafeGetCSObj(L, 1) as Array;
+                int components = floatVectorComponents(translator, array);
+                if (components == 0)
+                {
+                    return LuaAPI.luaL_error(L, "xlua.to_float_table: #1 argument must be a one-dimensional array of a GCOptimize float struct");
+                }
+                CopyByValue.PackFloatArray(L, array, components);
+                return 1;
+            }
+            catch (Exception e)
+            {
+                return LuaAPI.luaL_error(L, "c# exception in xlua.to_float_table: " + e);
+            }
+        }
+
+        [MonoPInvokeCallback(typeof(LuaCSFunction))]
+        public static int CopyFloatTable(RealStatePtr L)
+        {
+            try
+            {
+                ObjectTranslator translator = ObjectTranslatorPool.Instance.Find(L);
+                Array array = translator.SafeGetCSObj(L, 2) as Array;
+                int components = floatVectorComponents(translator, array);
+                if (components == 0)
+                {
+                    return LuaAPI.luaL_error(L, "xlua.copy_float_table: #2 argument must be a one-dimensional array of a GCOptimize float struct");
+                }
+                if (!LuaAPI.lua_istable(L, 1))
+                {
+                    return LuaAPI.luaL_error(L, "xlua.copy_float_table: #1 argument must be a table of numbers");
+                }
+                LuaAPI.xlua_pushinteger(L, CopyByValue.UnPackFloatArray(L, 1, array, components));
+                return 1;
+            }
+            catch (Exception e)
+            {
+                return LuaAPI.luaL_error(L, "c# exception in xlua.copy_float_table: " + e);
+            }
+        }
     }
 }
\ No newline at end of file
@@ -656,6 +656,8 @@ namespace XLua
 			makeReflectionWrap(L, type, cls_field, cls_getter, cls_setter, obj_field, obj_getter, obj_setter, obj_meta,
 				out item_getter, out item_setter, BindingFlags.NonPublic);
 			LuaAPI.lua_settop(L, oldTop);
+			// 成员表被改写，丢弃indexer里缓存的查找结果
+			LuaAPI.xlua_indexer_cache_invalidate();
 
 			foreach (var nested_type in type.GetNestedTypes(BindingFlags.NonPublic))
 			{
@@ -23,6 +23,45 @@ namespace XLua.LuaDLL
         KeyOfTable = 3,
         Metatable = 4,
         Upvalue = 5,
+        CClosureUpvalue = 6,
+        UserdataMetatable = 7,
+        Uservalue = 8,
+        StackSlot = 9,
+    }
+
+    // record of the incremental heap walk, Type 0 is the size (in D) of table Parent
+    [StructLayout(LayoutKind.Sequential)]
+    public struct HeapEdge
+    {
+        public IntPtr Parent;
+        public IntPtr Child;
+        public double D;
+        public int Type;
+        public int Key; // offset in the string buffer, -1 if none
+        public int Key2;
+    }
+
+    [Flags]
+    public enum HeapWalkFlags
+    {
+        Edges = 1,
+        TableSizes = 2,
+        FastSize = 4,
+        Snapshot = 8,
+    }
+
+    // object of the newer snapshot whose entry count grew, Path is an offset in the string buffer of the diff
+    [StructLayout(LayoutKind.Sequential)]
+    public struct HeapDiffEntry
+    {
+        public ulong Id;
+        public ulong Retained; // bytes freed with the object, per the dominator tree
+        public uint Type;
+        public uint Bytes;
+        public uint CountFrom;
+        public uint CountTo;
+        public int Path; // -1 if unreachable
+        public uint Reserved;
     }
 
     public partial class Lua
@@ -38,6 +77,63 @@ namespace XLua.LuaDLL
 
         [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
         public static extern IntPtr xlua_global_pointer(IntPtr L);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_heapwalk_begin(IntPtr L, HeapWalkFlags flags);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_heapwalk_step(IntPtr L, IntPtr walker, int budget);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_heapwalk_edges(IntPtr walker, out int count);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_heapwalk_strings(IntPtr walker, out int size);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_heapwalk_overflowed(IntPtr walker);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_heapwalk_clear(IntPtr walker);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_heapwalk_end(IntPtr L, IntPtr walker);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_heapwalk_take_snapshot(IntPtr walker);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_heap_snapshot(IntPtr L);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshot_serialize(IntPtr snapshot, out int size);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int xlua_snapshot_save(IntPtr snapshot, string path);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshot_load(byte[] buf, int size);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshot_load_file(string path);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_snapshot_free(IntPtr snapshot);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshot_diff(IntPtr from, IntPtr to);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshotdiff_entries(IntPtr diff, out int count);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshotdiff_strings(IntPtr diff, out int size);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void xlua_snapshotdiff_free(IntPtr diff);
+
+        [DllImport(LUADLL, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr xlua_snapshot_retainers(IntPtr snapshot, int maxCount);
     }
 }
 
@@ -46,6 +142,7 @@ namespace XLua
     using System.Collections.Generic;
     using System.Text;
     using System.Linq;
+    using System.Runtime.InteropServices;
 
     public static class LuaMemoryLeakChecker
     {
@@ -94,7 +191,7 @@ namespace XLua
             return data;
         }
 
-        struct RefInfo
+        internal struct RefInfo
         {
             public string Key;
 
@@ -116,13 +213,56 @@ namespace XLua
                 case LuaDLL.RelationshipType.KeyOfTable:
                     return KEY_OF_TABLE;
                 case LuaDLL.RelationshipType.Metatable:
+                case LuaDLL.RelationshipType.UserdataMetatable:
                     return METATABLE_KEY;
                 case LuaDLL.RelationshipType.Upvalue:
                     return string.Format("{0}:local {1}", key, key2);
+                case LuaDLL.RelationshipType.CClosureUpvalue:
+                    return string.Format("<upvalue {0}>", d);
+                case LuaDLL.RelationshipType.Uservalue:
+                    return string.Format("<uservalue {0}>", d);
+                case LuaDLL.RelationshipType.StackSlot:
+                    return string.Format("<stack {0}>", d);
             }
             return UNKNOW_KEY;
         }
 
+        static void addRelationship(Dictionary<IntPtr, List<RefInfo>> result, IntPtr registryPointer, IntPtr globalPointer,
+            IntPtr parent, IntPtr child, LuaDLL.RelationshipType type, string key, double d, string key2)
+        {
+            List<RefInfo> infos;
+            if (!result.TryGetValue(child, out infos))
+            {
+                infos = new List<RefInfo>();
+                result.Add(child, infos);
+            }
+            string keyOfRef = makeKey(type, key, d, key2);
+
+            bool hasNext = type != LuaDLL.RelationshipType.Upvalue;
+
+            if (hasNext)
+            {
+                if (parent == registryPointer)
+                {
+                    keyOfRef = "_R." + keyOfRef;
+                    hasNext = false;
+                }
+                else if (parent == globalPointer)
+                {
+                    keyOfRef = "_G." + keyOfRef;
+                    hasNext = false;
+                }
+            }
+
+            infos.Add(new RefInfo()
+            {
+                Key = keyOfRef,
+                HasNext = hasNext,
+                Parent = parent,
+                IsNumberKey = type == LuaDLL.RelationshipType.NumberKeyTableValue,
+            });
+        }
+
         static Dictionary<IntPtr, List<RefInfo>> getRelationship(LuaEnv env)
         {
             Dictionary<IntPtr, List<RefInfo>> result = new Dictionary<IntPtr, List<RefInfo>>();
@@ -131,39 +271,9 @@ namespace XLua
             IntPtr globalPointer = LuaDLL.Lua.xlua_global_pointer(env.L);
 
             LuaDLL.Lua.xlua_report_object_relationship(env.L, (IntPtr parent, IntPtr child, LuaDLL.RelationshipType type, string key, double d, string key2) => {
-                List<RefInfo> infos;
                 try
                 {
-                    if (!result.TryGetValue(child, out infos))
-                    {
-                        infos = new List<RefInfo>();
-                        result.Add(child, infos);
-                    }
-                    string keyOfRef = makeKey(type, key, d, key2);
-
-                    bool hasNext = type != LuaDLL.RelationshipType.Upvalue;
-
-                    if (hasNext)
-                    {
-                        if (parent == registryPointer)
-                        {
-                            keyOfRef = "_R." + keyOfRef;
-                            hasNext = false;
-                        }
-                        else if (parent == globalPointer)
-                        {
-                            keyOfRef = "_G." + keyOfRef;
-                            hasNext = false;
-                        }
-                    }
-
-                    infos.Add(new RefInfo()
-                    {
-                        Key = keyOfRef,
-                        HasNext = hasNext,
-                        Parent = parent,
-                        IsNumberKey = type == LuaDLL.RelationshipType.NumberKeyTableValue,
-                    });
+                    addRelationship(result, registryPointer, globalPointer, parent, child, type, key, d, key2);
                 }
                 catch (Exception e)
                 {
@@ -204,11 +314,310 @@ namespace XLua
             return findGrowing(last, getSizeReport(env));
         }
 
+        /// <summary>
+        /// 分帧版本的MemoryLeakCheck：last与一次完成的StartHeapWalk得到的Data比较
+        /// </summary>
+        public static Data MemoryLeakCheck(this Data last, Data current)
+        {
+            return findGrowing(last, current);
+        }
+
+        /// <summary>
+        /// 增量遍历lua堆，每帧调用Step(budget)直到返回true，期间lua正常运行，GC也可以正常进行；
+        /// 遍历期间新建的对象不会被统计。withRelationship为true时同时收集MemoryLeakReport所需的引用关系
+        /// </summary>
+        public static HeapWalk StartHeapWalk(this LuaEnv env, bool withRelationship = false)
+        {
+            return new HeapWalk(env, withRelationship);
+        }
+
+        /// <summary>
+        /// 分帧生成二进制堆快照，完成后从HeapWalk.Snapshot取得，可保存到文件，之后用DiffHeapSnapshot离线比较
+        /// </summary>
+        public static HeapWalk StartHeapSnapshot(this LuaEnv env)
+        {
+            return new HeapWalk(env, false, true);
+        }
+
+        /// <summary>
+        /// 一次性生成二进制堆快照
+        /// </summary>
+        public static byte[] TakeHeapSnapshot(this LuaEnv env)
+        {
+            env.FullGc();
+            IntPtr snapshot = LuaDLL.Lua.xlua_heap_snapshot(env.L);
+            if (snapshot == IntPtr.Zero)
+            {
+                throw new OutOfMemoryException("heap snapshot");
+            }
+            return serialize(snapshot);
+        }
+
+        static byte[] serialize(IntPtr snapshot)
+        {
+            try
+            {
+                int size;
+                IntPtr buf = LuaDLL.Lua.xlua_snapshot_serialize(snapshot, out size);
+                if (buf == IntPtr.Zero)
+                {
+                    throw new OutOfMemoryException("heap snapshot");
+                }
+                byte[] bytes = new byte[size];
+                Marshal.Copy(buf, bytes, 0, size);
+                return bytes;
+            }
+            finally
+            {
+                LuaDLL.Lua.xlua_snapshot_free(snapshot);
+            }
+        }
+
+        public class HeapObjectInfo
+        {
+            public ulong Id;
+            public LuaTypes Type;
+            public int Bytes;
+            public long Retained;
+            public int CountFrom;
+            public int CountTo;
+            public string Path; // null if unreachable
+
+            public override string ToString()
+            {
+                if (CountTo != CountFrom)
+                {
+                    return string.Format("potential leak({0}) in {{{1}}}, retained {2}", CountTo - CountFrom, Path, Retained);
+                }
+                return string.Format("retained {0} by {{{1}}}", Retained, Path);
+            }
+        }
+
+        /// <summary>
+        /// 比较两个快照，返回元素个数增长了的对象（增长多的在前）及其最短引用路径、保留大小，不需要LuaEnv
+        /// </summary>
+        public static List<HeapObjectInfo> DiffHeapSnapshot(byte[] from, byte[] to)
+        {
+            IntPtr a = LuaDLL.Lua.xlua_snapshot_load(from, from.Length);
+            IntPtr b = LuaDLL.Lua.xlua_snapshot_load(to, to.Length);
+            IntPtr diff = IntPtr.Zero;
+            try
+            {
+                if (a == IntPtr.Zero || b == IntPtr.Zero)
+                {
+                    throw new ArgumentException("invalid heap snapshot");
+                }
+                diff = LuaDLL.Lua.xlua_snapshot_diff(a, b);
+                if (diff == IntPtr.Zero)
+                {
+                    throw new OutOfMemoryException("heap snapshot diff");
+                }
+                return readEntries(diff);
+            }
+            finally
+            {
+                LuaDLL.Lua.xlua_snapshotdiff_free(diff);
+                LuaDLL.Lua.xlua_snapshot_free(a);
+                LuaDLL.Lua.xlua_snapshot_free(b);
+            }
+        }
+
+        /// <summary>
+        /// 按支配树计算的保留大小（对象被释放时连带释放的字节数）列出快照中最重的maxCount个对象，不需要LuaEnv
+        /// </summary>
+        public static List<HeapObjectInfo> HeapRetainers(byte[] snapshot, int maxCount = 20)
+        {
+            IntPtr snap = LuaDLL.Lua.xlua_snapshot_load(snapshot, snapshot.Length);
+            IntPtr retainers = IntPtr.Zero;
+            try
+            {
+                if (snap == IntPtr.Zero)
+                {
+                    throw new ArgumentException("invalid heap snapshot");
+                }
+                retainers = LuaDLL.Lua.xlua_snapshot_retainers(snap, maxCount);
+                if (retainers == IntPtr.Zero)
+                {
+                    throw new OutOfMemoryException("heap snapshot retainers");
+                }
+                return readEntries(retainers);
+            }
+            finally
+            {
+                LuaDLL.Lua.xlua_snapshotdiff_free(retainers);
+                LuaDLL.Lua.xlua_snapshot_free(snap);
+            }
+        }
+
+        static List<HeapObjectInfo> readEntries(IntPtr diff)
+        {
+            int count, size;
+            IntPtr entries = LuaDLL.Lua.xlua_snapshotdiff_entries(diff, out count);
+            IntPtr native = LuaDLL.Lua.xlua_snapshotdiff_strings(diff, out size);
+            byte[] strings = new byte[size];
+            if (size > 0)
+            {
+                Marshal.Copy(native, strings, 0, size);
+            }
+            int entrySize = Marshal.SizeOf(typeof(LuaDLL.HeapDiffEntry));
+            List<HeapObjectInfo> result = new List<HeapObjectInfo>(count);
+            for (int i = 0; i < count; i++)
+            {
+                var entry = (LuaDLL.HeapDiffEntry)Marshal.PtrToStructure(new IntPtr(entries.ToInt64() + (long)i * entrySize), typeof(LuaDLL.HeapDiffEntry));
+                string path = null;
+                if (entry.Path >= 0)
+                {
+                    int end = Array.IndexOf(strings, (byte)0, entry.Path);
+                    path = Encoding.UTF8.GetString(strings, entry.Path, end - entry.Path);
+                }
+                result.Add(new HeapObjectInfo()
+                {
+                    Id = entry.Id,
+                    Type = (LuaTypes)(entry.Type & 0x0F),
+                    Bytes = (int)entry.Bytes,
+                    Retained = (long)entry.Retained,
+                    CountFrom = (int)entry.CountFrom,
+                    CountTo = (int)entry.CountTo,
+                    Path = path,
+                });
+            }
+            return result;
+        }
+
+        public class HeapWalk : IDisposable
+        {
+            LuaEnv env;
+            IntPtr walker;
+            IntPtr registryPointer;
+            IntPtr globalPointer;
+            byte[] strings = new byte[0];
+            static readonly int edgeSize = Marshal.SizeOf(typeof(LuaDLL.HeapEdge));
+
+            public Data Data { get; private set; }
+
+            // StartHeapSnapshot的结果，遍历完成前为null
+            public byte[] Snapshot { get; private set; }
+
+            internal Dictionary<IntPtr, List<RefInfo>> Relationship { get; private set; }
+
+            public bool Done { get; private set; }
+
+            // some records were lost because the native buffer could not grow
+            public bool Overflowed { get; private set; }
+
+            internal HeapWalk(LuaEnv env, bool withRelationship, bool snapshot = false)
+            {
+                this.env = env;
+                Data = new Data();
+                Data.Memroy = env.MemoryB;
+                LuaDLL.HeapWalkFlags flags = snapshot ? LuaDLL.HeapWalkFlags.Snapshot : LuaDLL.HeapWalkFlags.TableSizes;
+                if (withRelationship && !snapshot)
+                {
+                    flags |= LuaDLL.HeapWalkFlags.Edges;
+                    Relationship = new Dictionary<IntPtr, List<RefInfo>>();
+                    registryPointer = LuaDLL.Lua.xlua_registry_pointer(env.L);
+                    globalPointer = LuaDLL.Lua.xlua_global_pointer(env.L);
+                }
+                walker = LuaDLL.Lua.xlua_heapwalk_begin(env.L, flags);
+            }
+
+            /// <summary>
+            /// 最多遍历budget个对象，遍历完成时返回true
+            /// </summary>
+            public bool Step(int budget)
+            {
+                if (Done)
+                {
+                    return true;
+                }
+                bool more = LuaDLL.Lua.xlua_heapwalk_step(env.L, walker, budget) != 0;
+                drain();
+                if (!more)
+                {
+                    IntPtr snapshot = LuaDLL.Lua.xlua_heapwalk_take_snapshot(walker);
+                    if (snapshot != IntPtr.Zero)
+                    {
+                        Snapshot = serialize(snapshot);
+                    }
+                    Dispose();
+                }
+                return Done;
+            }
+
+            void drain()
+            {
+                int count, size;
+                IntPtr edges = LuaDLL.Lua.xlua_heapwalk_edges(walker, out count);
+                IntPtr native = LuaDLL.Lua.xlua_heapwalk_strings(walker, out size);
+                if (size > strings.Length)
+                {
+                    strings = new byte[Math.Max(size, strings.Length * 2)];
+                }
+                if (size > 0)
+                {
+                    Marshal.Copy(native, strings, 0, size);
+                }
+                for (int i = 0; i < count; i++)
+                {
+                    var edge = (LuaDLL.HeapEdge)Marshal.PtrToStructure(new IntPtr(edges.ToInt64() + (long)i * edgeSize), typeof(LuaDLL.HeapEdge));
+                    if (edge.Type == 0)
+                    {
+                        Data.TableSizes[edge.Parent] = (int)edge.D;
+                    }
+                    else
+                    {
+                        addRelationship(Relationship, registryPointer, globalPointer, edge.Parent, edge.Child,
+                            (LuaDLL.RelationshipType)edge.Type, getString(edge.Key), edge.D, getString(edge.Key2));
+                    }
+                }
+                Overflowed |= LuaDLL.Lua.xlua_heapwalk_overflowed(walker) != 0;
+                LuaDLL.Lua.xlua_heapwalk_clear(walker);
+            }
+
+            string getString(int offset)
+            {
+                if (offset < 0)
+                {
+                    return null;
+                }
+                int end = Array.IndexOf(strings, (byte)0, offset);
+                return Encoding.UTF8.GetString(strings, offset, end - offset);
+            }
+
+            public void Dispose()
+            {
+                if (walker != IntPtr.Zero)
+                {
+                    if (env.rawL != IntPtr.Zero) // walker has gone with the lua state
+                    {
+                        LuaDLL.Lua.xlua_heapwalk_end(env.L, walker);
+                    }
+                    walker = IntPtr.Zero;
+                }
+                Done = true;
+            }
+        }
+
         public static string MemoryLeakReport(this LuaEnv env, Data data, int maxLevel = 10)
         {
             env.FullGc();
-            var relationshipInfo = getRelationship(env);
+            return makeReport(data, getRelationship(env), maxLevel);
+        }
 
+        /// <summary>
+        /// 与MemoryLeakReport相同，引用关系取自一次完成的StartHeapWalk(env, true)
+        /// </summary>
+        public static string MemoryLeakReport(this HeapWalk walk, Data data, int maxLevel = 10)
+        {
+            if (!walk.Done || walk.Relationship == null)
+            {
+                throw new InvalidOperationException("heap walk without relationship is not finished");
+            }
+            return makeReport(data, walk.Relationship, maxLevel);
+        }
+
+        static string makeReport(Data data, Dictionary<IntPtr, List<RefInfo>> relationshipInfo, int maxLevel)
+        {
             StringBuilder sb = new StringBuilder();
             sb.AppendLine("total memroy: " + data.Memroy);
             foreach(var kv in data.TableSizes)
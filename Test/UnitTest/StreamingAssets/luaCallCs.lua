@@ -2317,4 +2317,101 @@ function CMyTestCaseLuaCallCS.CaseVariableParamFuncNoParam(self)
 	ASSERT_EQ(ret, 0)
 	local ret = CS.LuaTestObj.VariableParamFunc2("abc", "haha")
 	ASSERT_EQ(ret, 2)
+end
+
+-- 对象被回收时通知，5.1/luajit的table不支持__gc，用newproxy
+local function setgcnotify(fn)
+	if newproxy then
+		local proxy = newproxy(true)
+		getmetatable(proxy).__gc = fn
+		return proxy
+	else
+		return setmetatable({}, {__gc = fn})
+	end
+end
+
+function CMyTestCaseLuaCallCS.CaseObjectRepushBeforeGc(self)
+    self.count = 1 + self.count
+	local repushed
+	-- 在单独的函数里创建，保证返回后栈上没有残留引用
+	local function prepare()
+		CS.LuaTestObj.heldObj = CS.LuaTestObj()
+		CS.LuaTestObj.heldObj.testVar = 42
+		-- 后创建的先析构：userdata已从缓存表清除，但它的__gc还没执行
+		setgcnotify(function() repushed = CS.LuaTestObj.heldObj end)
+	end
+	prepare()
+	collectgarbage()
+	collectgarbage()
+	ASSERT_NE(repushed, nil)
+	ASSERT_EQ(repushed.testVar, 42)
+	ASSERT_TRUE(rawequal(repushed, CS.LuaTestObj.heldObj))
+	CS.LuaTestObj.heldObj = nil
+end
+
+function CMyTestCaseLuaCallCS.CaseObjectIndexRecycle(self)
+    self.count = 1 + self.count
+	local function fill(n, base)
+		local objs = {}
+		for i = 1, n do
+			local obj = CS.LuaTestObj()
+			obj.testVar = base + i
+			objs[i] = obj
+		end
+		return objs
+	end
+	fill(100, 0)
+	collectgarbage()
+	collectgarbage()
+	local objs = fill(100, 1000)
+	collectgarbage()
+	for i = 1, 100 do
+		ASSERT_EQ(objs[i].testVar, 1000 + i)
+	end
+end
+
+function CMyTestCaseLuaCallCS.CaseObjectReleaseRepush(self)
+    self.count = 1 + self.count
+	CS.LuaTestObj.heldObj = CS.LuaTestObj()
+	local old = CS.LuaTestObj.heldObj
+	old.testVar = 42
+	xlua.release(old)
+	local ret = pcall(function() return old.testVar end)
+	ASSERT_EQ(ret, false)
+	local new = CS.LuaTestObj.heldObj
+	ASSERT_FALSE(rawequal(old, new))
+	ASSERT_EQ(new.testVar, 42)
+	old = nil
+	collectgarbage()
+	collectgarbage()
+	ASSERT_EQ(new.testVar, 42)
+	ASSERT_TRUE(rawequal(new, CS.LuaTestObj.heldObj))
+	CS.LuaTestObj.heldObj = nil
+end
+
+function CMyTestCaseLuaCallCS.CaseEnumRoundTrip1(self)
+    self.count = 1 + self.count
+	local enumValue = CS.LuaTestType.GHI
+	ASSERT_EQ(type(enumValue), "number")
+	ASSERT_EQ(enumValue, 2)
+	ASSERT_EQ(CS.LuaTestObj.EchoEnum(enumValue), 2)
+	ASSERT_EQ(CS.LuaTestObj.TestEnumFunc(CS.LuaTestObj.EchoEnum(CS.LuaTestType.JKL)), 3)
+	ASSERT_EQ(CS.LuaTestObj.EchoEnum(CS.LuaTestType.__CastFrom("DEF")), 1)
+end
+
+function CMyTestCaseLuaCallCS.CaseEnumRoundTrip2(self)
+    self.count = 1 + self.count
+	-- 未定义的值和组合值不在缓存里，也要能来回转换
+	ASSERT_EQ(CS.LuaTestObj.EchoEnum(CS.LuaTestType.__CastFrom(7)), 7)
+	ASSERT_EQ(CS.LuaTestObj.EchoFlags(CS.LuaTestFlags.A + CS.LuaTestFlags.C), 5)
+	ASSERT_EQ(CS.LuaTestObj.EchoFlags(0), 0)
+end
+
+function CMyTestCaseLuaCallCS.CaseEnumRoundTrip3(self)
+    self.count = 1 + self.count
+	ASSERT_EQ(type(CS.LuaTestLongEnum.SMALL), "number")
+	ASSERT_EQ(CS.LuaTestObj.EchoLongEnum(CS.LuaTestLongEnum.SMALL), 1)
+	local bigValue = CS.LuaTestObj.EchoLongEnum(CS.LuaTestLongEnum.BIG)
+	ASSERT_EQ(tostring(bigValue), "1152921504606846976")
+	ASSERT_EQ(bigValue, CS.LuaTestLongEnum.BIG)
 end
\ No newline at end of file
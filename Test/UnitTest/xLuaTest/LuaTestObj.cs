@@ -26,6 +26,22 @@ public enum FirstPushEnum
 	E1
 };
 
+[LuaCallCSharp]
+public enum LuaTestLongEnum : long
+{
+	SMALL = 1,
+	BIG = 1L << 60 // 超出double精确范围，5.1/luajit下走int64
+};
+
+[LuaCallCSharp]
+[Flags]
+public enum LuaTestFlags
+{
+	A = 1,
+	B = 2,
+	C = 4
+};
+
 [CSharpCallLua]
 public delegate int TestDelegate(int x);
 [CSharpCallLua]
@@ -232,6 +248,24 @@ public class LuaTestObj
 		return (int)x;
 	}
 
+	public static LuaTestType EchoEnum(LuaTestType x)
+	{
+		return x;
+	}
+
+	public static LuaTestLongEnum EchoLongEnum(LuaTestLongEnum x)
+	{
+		return x;
+	}
+
+	public static LuaTestFlags EchoFlags(LuaTestFlags x)
+	{
+		return x;
+	}
+
+	// C#侧一直持有的对象，用于测试lua侧userdata回收前后的再次push
+	public static LuaTestObj heldObj;
+
 	public static string TestGetType(Type x)
 	{
 		return x.ToString ();
@@ -0,0 +1,434 @@
+/*
+ *Tencent is pleased to support the open source community by making xLua available.
+ *Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ *Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You
+ *may obtain a copy of the License at http://opensource.org/licenses/MIT Unless required by applicable law or agreed to
+ *in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+// measures the bridge primitives of xlua.c / sidlrt.cpp outside Unity: C# is replaced by stub callbacks registered
+// through xlua_set_csharp_wrapper_caller, every case reports ns/op and lua allocations/op.
+// usage: xlua_bench [iterations] [filter] [sidl type name]
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+typedef int (*lua_CSWrapperCaller)(lua_State *L, int wrapperid, int top);
+typedef int (*lua_CSWrapper)(lua_State *L, int top);
+
+extern "C" {
+lua_State *xlua_newstate();
+int xlua_alloc_stats(lua_State *L, int cls, unsigned int *block_size, uint64_t *live_bytes, uint64_t *live_blocks,
+                     uint64_t *reserved_bytes);
+void luaopen_xlua(lua_State *L);
+void luaopen_sidlrt(lua_State *L);
+int xlua_tryget_cachedud(lua_State *L, int key, int cache_ref);
+void xlua_pushcsobj(lua_State *L, int key, int meta_ref, int need_cache, int cache_ref);
+void *xlua_new_csobj_handles(lua_State *L);
+int xlua_tryget_csobj(lua_State *L, void *handles, int key);
+void xlua_pushcsobj_handle(lua_State *L, void *handles, int key, int meta_ref, int need_cache);
+void xlua_pushlstring(lua_State *L, const char *s, int len);
+int xlua_stringhandle(lua_State *L, const char *s, int len);
+void xlua_pushstringhandle(lua_State *L, int handle);
+int xlua_pgettable(lua_State *L, int idx);
+int xlua_psettable(lua_State *L, int idx);
+int xlua_getglobal(lua_State *L, const char *name);
+int xlua_setglobal(lua_State *L, const char *name);
+int xlua_pgettable_bypath(lua_State *L, int idx, const char *path);
+int xlua_psettable_bypath(lua_State *L, int idx, const char *path);
+int xlua_compile_path(lua_State *L, const char *path);
+int xlua_pgettable_bypathref(lua_State *L, int idx, int path_ref);
+int xlua_psettable_bypathref(lua_State *L, int idx, int path_ref);
+int gen_obj_indexer(lua_State *L);
+void xlua_set_csharp_wrapper_caller(lua_CSWrapperCaller wrapper_caller);
+void xlua_push_csharp_wrapper(lua_State *L, int wrapperid);
+void xlua_push_csharp_wrapper_direct(lua_State *L, lua_CSWrapper fn);
+void *xlua_pushstruct(lua_State *L, unsigned int size, int meta_ref);
+void xlua_pushsidlobj(lua_State *L, uint64_t instance_id);
+}
+
+#define T_FLOAT 8
+
+namespace {
+
+/*
+** allocation counting: wraps whatever allocator the state was created with (LuaJIT on x64 only supports its own)
+*/
+struct AllocStats {
+  lua_Alloc inner;
+  void *inner_ud;
+  uint64_t allocs;
+};
+
+void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  AllocStats *stats = (AllocStats *)ud;
+  if (nsize > 0 && (ptr == NULL || nsize > osize)) {
+    stats->allocs++;
+  }
+  return stats->inner(stats->inner_ud, ptr, osize, nsize);
+}
+
+/*
+** stub C#: wrapper id is echoed back as the result, as a generated getter returning a number would. The id
+** EMPTY_WRAPPER_ID stands for an empty method and is dispatched like CSharpWrapperCallerImpl does, through an array.
+*/
+uint64_t stub_calls = 0;
+
+#define EMPTY_WRAPPER_ID 1
+
+int empty_wrapper(lua_State *L, int top) {
+  (void)L;
+  (void)top;
+  stub_calls++;
+  return 0;
+}
+
+lua_CSWrapper stub_wrappers[] = {NULL, empty_wrapper};
+
+int stub_wrapper_caller(lua_State *L, int wrapperid, int top) {
+  if (wrapperid == EMPTY_WRAPPER_ID) {
+    return stub_wrappers[wrapperid](L, top);
+  }
+  stub_calls++;
+  lua_pushnumber(L, wrapperid);
+  return 1;
+}
+
+struct Bench {
+  const char *name;
+  void (*setup)(lua_State *L);  // leaves whatever op needs on the stack
+  void (*op)(lua_State *L, int i);
+};
+
+int meta_ref = LUA_NOREF;
+int path_ref = LUA_NOREF;
+int string_handle = LUA_NOREF;
+const char bench_string[] = "OnPlayerInventoryChanged";
+int cache_ref = LUA_NOREF;
+void *csobj_handles = NULL;
+uint64_t sidl_id = 0;
+const char *sidl_type = "Bench";
+
+// the shape ObjectTranslator gives a C# object: a metatable with the obj_indexer closure as __index
+void push_indexer(lua_State *L) {
+  lua_newtable(L);  // methods
+  lua_pushcfunction(L, lua_gettop);
+  lua_setfield(L, -2, "Method");
+  lua_newtable(L);  // getters
+  xlua_push_csharp_wrapper(L, 7);
+  lua_setfield(L, -2, "Property");
+  lua_pushnil(L);  // csindexer
+  lua_pushnil(L);  // base
+  lua_newtable(L);  // indexfuncs
+  lua_pushnil(L);  // arrayindexer
+  gen_obj_indexer(L);
+}
+
+void setup_none(lua_State *L) { (void)L; }
+
+void op_pushcsobj(lua_State *L, int i) {
+  xlua_pushcsobj(L, i, meta_ref, 1, cache_ref);
+  lua_pop(L, 1);
+}
+
+void setup_cachedud(lua_State *L) {
+  xlua_pushcsobj(L, 0, meta_ref, 1, cache_ref);  // kept on the stack so the weak cache entry stays alive
+}
+
+void op_tryget_cachedud(lua_State *L, int i) {
+  (void)i;
+  if (xlua_tryget_cachedud(L, 0, cache_ref)) {
+    lua_pop(L, 1);
+  }
+}
+
+void op_pushcsobj_handle(lua_State *L, int i) {
+  xlua_pushcsobj_handle(L, csobj_handles, i, meta_ref, 1);
+  lua_pop(L, 1);
+}
+
+void setup_tryget_csobj(lua_State *L) {
+  xlua_pushcsobj_handle(L, csobj_handles, 0, meta_ref, 1);  // kept on the stack so the cached userdata stays alive
+}
+
+void op_tryget_csobj(lua_State *L, int i) {
+  (void)i;
+  if (xlua_tryget_csobj(L, csobj_handles, 0)) {
+    lua_pop(L, 1);
+  }
+}
+
+void setup_csobj(lua_State *L) { xlua_pushcsobj(L, 1, meta_ref, 0, cache_ref); }
+
+void op_indexer_method(lua_State *L, int i) {
+  (void)i;
+  lua_getfield(L, -1, "Method");
+  lua_pop(L, 1);
+}
+
+void op_indexer_getter(lua_State *L, int i) {
+  (void)i;
+  lua_getfield(L, -1, "Property");
+  lua_pop(L, 1);
+}
+
+// empty C# method latency in both wrapper modes; the closure is left on the stack by setup
+void setup_wrapper_caller(lua_State *L) { xlua_push_csharp_wrapper(L, EMPTY_WRAPPER_ID); }
+
+void setup_wrapper_direct(lua_State *L) { xlua_push_csharp_wrapper_direct(L, empty_wrapper); }
+
+void op_call_wrapper(lua_State *L, int i) {
+  (void)i;
+  lua_pushvalue(L, -1);
+  lua_call(L, 0, 0);
+}
+
+void op_pushlstring(lua_State *L, int i) {
+  (void)i;
+  xlua_pushlstring(L, bench_string, sizeof(bench_string) - 1);
+  lua_pop(L, 1);
+}
+
+void setup_stringhandle(lua_State *L) { string_handle = xlua_stringhandle(L, bench_string, sizeof(bench_string) - 1); }
+
+void op_pushstringhandle(lua_State *L, int i) {
+  (void)i;
+  xlua_pushstringhandle(L, string_handle);
+  lua_pop(L, 1);
+}
+
+void setup_table(lua_State *L) {
+  luaL_dostring(L, "bench_table = {a = 1}");
+  lua_getglobal(L, "bench_table");
+}
+
+void op_pgettable(lua_State *L, int i) {
+  (void)i;
+  lua_pushstring(L, "a");
+  xlua_pgettable(L, -2);
+  lua_pop(L, 1);
+}
+
+void op_psettable(lua_State *L, int i) {
+  lua_pushstring(L, "a");
+  lua_pushnumber(L, i);
+  xlua_psettable(L, -3);
+}
+
+void op_getglobal(lua_State *L, int i) {
+  (void)i;
+  xlua_getglobal(L, "bench_table");
+  lua_pop(L, 1);
+}
+
+void op_setglobal(lua_State *L, int i) {
+  lua_pushnumber(L, i);
+  xlua_setglobal(L, "bench_global");
+}
+
+void setup_bypath(lua_State *L) {
+  luaL_dostring(L, "bench_path = {a = {b = {c = 1}}}");
+  lua_getglobal(L, "bench_path");
+}
+
+void op_pgettable_bypath(lua_State *L, int i) {
+  (void)i;
+  xlua_pgettable_bypath(L, -1, "a.b.c");
+  lua_pop(L, 1);
+}
+
+void op_psettable_bypath(lua_State *L, int i) {
+  lua_pushnumber(L, i);
+  xlua_psettable_bypath(L, -2, "a.b.c");
+}
+
+void setup_bypathref(lua_State *L) {
+  setup_bypath(L);
+  if (path_ref == LUA_NOREF) {
+    path_ref = xlua_compile_path(L, "a.b.c");
+  }
+}
+
+void op_pgettable_bypathref(lua_State *L, int i) {
+  (void)i;
+  xlua_pgettable_bypathref(L, -1, path_ref);
+  lua_pop(L, 1);
+}
+
+void op_psettable_bypathref(lua_State *L, int i) {
+  lua_pushnumber(L, i);
+  xlua_psettable_bypathref(L, -2, path_ref);
+}
+
+void setup_sidl(lua_State *L) {
+  xlua_pushsidlobj(L, sidl_id);  // hold one reference, so every op hits the handle map
+}
+
+void op_pushsidlobj(lua_State *L, int i) {
+  (void)i;
+  xlua_pushsidlobj(L, sidl_id);
+  lua_pop(L, 1);
+}
+
+void setup_struct(lua_State *L) {
+  lua_getglobal(L, "xlua");
+  lua_getfield(L, -1, "genaccessor");
+  lua_remove(L, -2);
+  lua_pushinteger(L, 4);
+  lua_pushinteger(L, T_FLOAT);
+  lua_call(L, 2, 3);  // getter, setter, nop
+  lua_pop(L, 1);
+  xlua_pushstruct(L, sizeof(float) * 3, meta_ref);
+}
+
+void op_struct_get(lua_State *L, int i) {
+  (void)i;
+  lua_pushvalue(L, -3);
+  lua_pushvalue(L, -2);
+  lua_call(L, 1, 1);
+  lua_pop(L, 1);
+}
+
+void op_struct_set(lua_State *L, int i) {
+  lua_pushvalue(L, -2);
+  lua_pushvalue(L, -2);
+  lua_pushnumber(L, i);
+  lua_call(L, 2, 0);
+}
+
+const Bench benches[] = {
+    {"xlua_pushcsobj(cache)", setup_none, op_pushcsobj},
+    {"xlua_tryget_cachedud", setup_cachedud, op_tryget_cachedud},
+    {"xlua_pushcsobj_handle", setup_none, op_pushcsobj_handle},
+    {"xlua_tryget_csobj", setup_tryget_csobj, op_tryget_csobj},
+    {"obj_indexer method", setup_csobj, op_indexer_method},
+    {"obj_indexer getter", setup_csobj, op_indexer_getter},
+    {"wrapper call(caller)", setup_wrapper_caller, op_call_wrapper},
+    {"wrapper call(direct)", setup_wrapper_direct, op_call_wrapper},
+    {"xlua_pushlstring", setup_none, op_pushlstring},
+    {"xlua_pushstringhandle", setup_stringhandle, op_pushstringhandle},
+    {"xlua_pgettable", setup_table, op_pgettable},
+    {"xlua_psettable", setup_table, op_psettable},
+    {"xlua_getglobal", setup_table, op_getglobal},
+    {"xlua_setglobal", setup_none, op_setglobal},
+    {"xlua_pgettable_bypath", setup_bypath, op_pgettable_bypath},
+    {"xlua_psettable_bypath", setup_bypath, op_psettable_bypath},
+    {"xlua_pgettable_bypathref", setup_bypathref, op_pgettable_bypathref},
+    {"xlua_psettable_bypathref", setup_bypathref, op_psettable_bypathref},
+    {"xlua_pushsidlobj(hit)", setup_sidl, op_pushsidlobj},
+    {"struct get float", setup_struct, op_struct_get},
+    {"struct set float", setup_struct, op_struct_set},
+};
+
+bool create_sidl_object(lua_State *L) {
+  lua_getglobal(L, "sidlrt");
+  lua_getfield(L, -1, "newobj");
+  lua_pushstring(L, sidl_type);
+  if (lua_pcall(L, 1, 1, 0) != 0 || lua_type(L, -1) != LUA_TUSERDATA) {
+    lua_pop(L, 2);
+    return false;
+  }
+  sidl_id = *(uint64_t *)lua_touserdata(L, -1);
+  lua_setglobal(L, "bench_sidl_obj");  // keeps the instance alive
+  lua_pop(L, 1);
+  return sidl_id != 0;
+}
+
+void run(lua_State *L, AllocStats *stats, const Bench &bench, int iterations) {
+  int top = lua_gettop(L);
+  int warmup = iterations / 10;
+  bench.setup(L);
+  for (int i = 0; i < warmup; i++) {
+    bench.op(L, i);
+  }
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  lua_gc(L, LUA_GCSTOP, 0);  // a collection cycle inside the timed loop would be charged to whichever op triggers it
+
+  uint64_t allocs = stats->allocs;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    bench.op(L, i);
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  allocs = stats->allocs - allocs;
+
+  lua_gc(L, LUA_GCRESTART, 0);
+  lua_settop(L, top);
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  printf("%-24s %10.2f ns/op %10.3f allocs/op\n", bench.name, elapsed / iterations, (double)allocs / iterations);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+  const char *filter = argc > 2 ? argv[2] : NULL;
+  if (argc > 3) {
+    sidl_type = argv[3];
+  }
+  if (iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations] [filter] [sidl type name]\n", argv[0]);
+    return 1;
+  }
+
+  // same state LuaEnv creates, XLUA_BENCH_DEFAULT_ALLOCATOR=1 to compare with the stock allocator
+  bool default_alloc = getenv("XLUA_BENCH_DEFAULT_ALLOCATOR") != NULL;
+  lua_State *L = default_alloc ? luaL_newstate() : xlua_newstate();
+  // xlua_newstate is luaL_newstate where the VM refuses custom allocators (x64 LuaJIT without GC64), ask before
+  // counting_alloc replaces the slab allocator
+  unsigned int block_size;
+  uint64_t live_bytes, live_blocks, reserved_bytes;
+  bool slab_alloc = xlua_alloc_stats(L, 0, &block_size, &live_bytes, &live_blocks, &reserved_bytes) != 0;
+  AllocStats stats;
+  stats.inner = lua_getallocf(L, &stats.inner_ud);
+  stats.allocs = 0;
+  lua_setallocf(L, counting_alloc, &stats);
+
+  luaL_openlibs(L);
+  luaopen_xlua(L);
+  luaopen_sidlrt(L);
+  xlua_set_csharp_wrapper_caller(stub_wrapper_caller);
+
+  // what ObjectTranslator sets up: a metatable per type and the C# object handle table (plus the weak valued
+  // userdata cache the older xlua_pushcsobj/xlua_tryget_cachedud pair uses)
+  lua_newtable(L);
+  lua_pushnumber(L, 1);
+  lua_rawseti(L, -2, 1);
+  push_indexer(L);
+  lua_setfield(L, -2, "__index");
+  meta_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_pushstring(L, "v");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+  cache_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  csobj_handles = xlua_new_csobj_handles(L);
+
+  bool has_sidl = create_sidl_object(L);
+  printf("%s, %s allocator, %d iterations\n", LUA_RELEASE, slab_alloc ? "xlua" : "default", iterations);
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    const Bench &bench = benches[i];
+    if (filter != NULL && strstr(bench.name, filter) == NULL) {
+      continue;
+    }
+    if (bench.op == op_pushsidlobj && !has_sidl) {
+      printf("%-24s skipped, sidlrt.newobj(\"%s\") failed\n", bench.name, sidl_type);
+      continue;
+    }
+    run(L, &stats, bench, iterations);
+  }
+  lua_close(L);
+  return 0;
+}
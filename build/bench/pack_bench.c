@@ -0,0 +1,182 @@
+/*
+ *Tencent is pleased to support the open source community by making xLua available.
+ *Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ *Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You
+ *may obtain a copy of the License at http://opensource.org/licenses/MIT Unless required by applicable law or agreed to
+ *in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+// compares the batched vector transfer (xlua_pushstructarray & co) with the per-element pack/unpack path a generated
+// wrapper takes for a Vector3[]/Quaternion[], usage: xlua_bench_pack [count] [rounds]
+
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+extern void *xlua_pushstruct(lua_State *L, unsigned int size, int meta_ref);
+extern void *xlua_tostruct(lua_State *L, int idx, int meta_ref);
+extern int xlua_pack_float3(void *p, int offset, float f1, float f2, float f3);
+extern int xlua_unpack_float3(void *p, int offset, float *f1, float *f2, float *f3);
+extern int xlua_pack_float4(void *p, int offset, float f1, float f2, float f3, float f4);
+extern int xlua_unpack_float4(void *p, int offset, float *f1, float *f2, float *f3, float *f4);
+extern int xlua_pushstructarray(lua_State *L, const void *src, int count, int components, int stride, int meta_ref);
+extern int xlua_tostructarray(lua_State *L, int idx, void *dst, int count, int components, int stride, int meta_ref);
+extern int xlua_pushfloatarray(lua_State *L, const void *src, int count, int components, int stride);
+extern int xlua_tofloatarray(lua_State *L, int idx, void *dst, int count, int components, int stride);
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+typedef struct {
+  float x, y, z;
+} Vec3;
+
+typedef struct {
+  float x, y, z, w;
+} Vec4;
+
+static Vec3 *v3_src, *v3_dst;
+static Vec4 *v4_src, *v4_dst;
+static int count;
+static int meta_ref;
+
+static void push_v3_each(lua_State *L) {
+  int i;
+  lua_createtable(L, count, 0);
+  for (i = 0; i < count; i++) {
+    void *p = xlua_pushstruct(L, sizeof(Vec3), meta_ref);
+    xlua_pack_float3(p, 0, v3_src[i].x, v3_src[i].y, v3_src[i].z);
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+static void to_v3_each(lua_State *L) {
+  int i;
+  for (i = 0; i < count; i++) {
+    lua_rawgeti(L, -1, i + 1);
+    if (xlua_tostruct(L, -1, meta_ref) != NULL) {
+      xlua_unpack_float3(lua_touserdata(L, -1), 0, &v3_dst[i].x, &v3_dst[i].y, &v3_dst[i].z);
+    }
+    lua_pop(L, 1);
+  }
+}
+
+static void push_v4_each(lua_State *L) {
+  int i;
+  lua_createtable(L, count, 0);
+  for (i = 0; i < count; i++) {
+    void *p = xlua_pushstruct(L, sizeof(Vec4), meta_ref);
+    xlua_pack_float4(p, 0, v4_src[i].x, v4_src[i].y, v4_src[i].z, v4_src[i].w);
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+static void to_v4_each(lua_State *L) {
+  int i;
+  for (i = 0; i < count; i++) {
+    lua_rawgeti(L, -1, i + 1);
+    if (xlua_tostruct(L, -1, meta_ref) != NULL) {
+      xlua_unpack_float4(lua_touserdata(L, -1), 0, &v4_dst[i].x, &v4_dst[i].y, &v4_dst[i].z, &v4_dst[i].w);
+    }
+    lua_pop(L, 1);
+  }
+}
+
+static void push_v3_batch(lua_State *L) { xlua_pushstructarray(L, v3_src, count, 3, sizeof(Vec3), meta_ref); }
+static void to_v3_batch(lua_State *L) { xlua_tostructarray(L, -1, v3_dst, count, 3, sizeof(Vec3), meta_ref); }
+static void push_v4_batch(lua_State *L) { xlua_pushstructarray(L, v4_src, count, 4, sizeof(Vec4), meta_ref); }
+static void to_v4_batch(lua_State *L) { xlua_tostructarray(L, -1, v4_dst, count, 4, sizeof(Vec4), meta_ref); }
+static void push_v3_flat(lua_State *L) { xlua_pushfloatarray(L, v3_src, count, 3, sizeof(Vec3)); }
+static void to_v3_flat(lua_State *L) { xlua_tofloatarray(L, -1, v3_dst, count, 3, sizeof(Vec3)); }
+
+typedef void (*BenchFunc)(lua_State *L);
+
+// push: time of building the table (collected between rounds), to: time of reading back a table pushed by push
+static void run(lua_State *L, const char *name, BenchFunc push, BenchFunc to, int rounds) {
+  int r;
+  double push_ns = 0, to_ns = 0, t;
+  for (r = 0; r < rounds; r++) {
+    t = now_ns();
+    push(L);
+    push_ns += now_ns() - t;
+    t = now_ns();
+    to(L);
+    to_ns += now_ns() - t;
+    lua_pop(L, 1);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+  }
+  printf("%-18s push %8.2f ns/elem   to %8.2f ns/elem\n", name, push_ns / rounds / count, to_ns / rounds / count);
+}
+
+int main(int argc, char **argv) {
+  int i, rounds;
+  lua_State *L;
+  count = argc > 1 ? atoi(argv[1]) : 4096;
+  rounds = argc > 2 ? atoi(argv[2]) : 200;
+  if (count <= 0 || rounds <= 0) {
+    fprintf(stderr, "usage: %s [count] [rounds]\n", argv[0]);
+    return 1;
+  }
+
+  v3_src = (Vec3 *)malloc(sizeof(Vec3) * count);
+  v3_dst = (Vec3 *)malloc(sizeof(Vec3) * count);
+  v4_src = (Vec4 *)malloc(sizeof(Vec4) * count);
+  v4_dst = (Vec4 *)malloc(sizeof(Vec4) * count);
+  for (i = 0; i < count; i++) {
+    v3_src[i].x = (float)i;
+    v3_src[i].y = (float)i * 0.5f;
+    v3_src[i].z = (float)-i;
+    v4_src[i].x = v4_src[i].y = v4_src[i].z = 0.5f;
+    v4_src[i].w = (float)i;
+  }
+
+  L = luaL_newstate();
+  luaL_openlibs(L);
+  // the struct metatable only needs the type id at [1] for xlua_tostruct
+  lua_newtable(L);
+  lua_pushnumber(L, 1);
+  lua_rawseti(L, -2, 1);
+  meta_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  printf("%d elements x %d rounds\n", count, rounds);
+  run(L, "Vector3 each", push_v3_each, to_v3_each, rounds);
+  run(L, "Vector3 batch", push_v3_batch, to_v3_batch, rounds);
+  run(L, "Vector3 flat", push_v3_flat, to_v3_flat, rounds);
+  run(L, "Quaternion each", push_v4_each, to_v4_each, rounds);
+  run(L, "Quaternion batch", push_v4_batch, to_v4_batch, rounds);
+
+  for (i = 0; i < count; i++) {
+    if (v4_dst[i].w != v4_src[i].w || v3_dst[i].z != v3_src[i].z) {
+      fprintf(stderr, "mismatch at %d\n", i);
+      return 1;
+    }
+  }
+
+  lua_close(L);
+  free(v3_src);
+  free(v3_dst);
+  free(v4_src);
+  free(v4_dst);
+  return 0;
+}
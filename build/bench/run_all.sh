@@ -0,0 +1,17 @@
+#!/bin/sh
+# builds the benchmarks against every bundled VM and runs them, extra arguments go to xlua_bench
+# (lua-5.1.5 only provides headers for the apple luajit build, lua-5.3.3/src carries the windows-only wmain.c)
+cd "$(dirname "$0")/.."
+for v in 5.3.4 5.3.5 5.4.1; do
+  mkdir -p build_bench_$v
+  cmake -S . -B build_bench_$v -DLUA_VERSION=$v -DXLUA_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release > /dev/null
+  cmake --build build_bench_$v --config Release > /dev/null || exit 1
+  build_bench_$v/xlua_bench "$@"
+done
+if [ ! -f luajit-2.1.0b3/src/libluajit.a ]; then
+  (cd luajit-2.1.0b3 && make CFLAGS=-fPIC)
+fi
+mkdir -p build_bench_lj
+cmake -S . -B build_bench_lj -DUSING_LUAJIT=ON -DXLUA_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release > /dev/null
+cmake --build build_bench_lj --config Release > /dev/null || exit 1
+build_bench_lj/xlua_bench "$@"
@@ -9,6 +9,7 @@
 #define LUA_LIB
 
 #include "i64lib.h"
+#include "slab_alloc.h"
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
@@ -54,13 +55,163 @@ typedef struct {
 	} data;
 } Integer64;
 
-LUALIB_API void lua_pushint64(lua_State* L, int64_t n) {
+/*
+** Integer64 boxes are immutable, so they are interned: while a box is alive every push of the same value and type
+** returns it, equal ids are rawequal and work directly as table keys, and pushing an id that is already held does not
+** allocate. A native open addressing table maps the value to a slot of a weak valued Lua table (the environment of the
+** table's userdata) that holds the box; an entry whose box was collected is reused for the same value, and the rest are
+** swept and their slots recycled when the table fills up.
+*/
+typedef struct {
+	int64_t value;
+	int slot; // index in the weak table, 0 for an empty entry
+	int8_t type;
+} InternEntry;
+
+typedef struct {
+	InternEntry* entries;
+	size_t size;
+	size_t count;
+	int* free_slots;
+	size_t free_count;
+	size_t free_size;
+	int next_slot;
+} Int64Intern;
+
+#define INT64_INTERN_MIN_SIZE 64
+
+static char int64_intern_key;
+
+static void push_box(lua_State* L, int64_t n, int8_t type) {
 	Integer64* p = (Integer64*)lua_newuserdata(L, sizeof(Integer64));
 	p->fake_id = -1;
 	p->data.i64 = n;
-	p->type = Int;
+	xlua_memstats_udata(L, p, MEM_INT64);
+	p->type = type;
 	lua_rawgeti(L, LUA_REGISTRYINDEX, INT64_META_REF);
-	lua_setmetatable(L, -2);            
+	lua_setmetatable(L, -2);
+}
+
+static InternEntry* intern_lookup(InternEntry* entries, size_t size, int64_t n, int8_t type) {
+	size_t mask = size - 1;
+	size_t pos = (size_t)((((uint64_t)n ^ (uint64_t)type) * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+	
+	while (entries[pos].slot != 0 && (entries[pos].value != n || entries[pos].type != type)) {
+		pos = (pos + 1) & mask;
+	}
+	return &entries[pos];
+}
+
+static void intern_free_slot(Int64Intern* t, int slot) {
+	if (t->free_count == t->free_size) {
+		size_t free_size = t->free_size == 0 ? INT64_INTERN_MIN_SIZE : t->free_size * 2;
+		int* free_slots = (int*)realloc(t->free_slots, sizeof(int) * free_size);
+		if (free_slots == NULL) {
+			return; // the slot is just never used again
+		}
+		t->free_slots = free_slots;
+		t->free_size = free_size;
+	}
+	t->free_slots[t->free_count++] = slot;
+}
+
+// drops the entries whose box was collected (the weak table is at stack index cache) and resizes to a load under half
+static int intern_rebuild(lua_State* L, Int64Intern* t, int cache) {
+	size_t i, live = 0, size = INT64_INTERN_MIN_SIZE;
+	InternEntry* entries;
+	
+	for (i = 0; i < t->size; i++) {
+		if (t->entries[i].slot != 0) {
+			lua_rawgeti(L, cache, t->entries[i].slot);
+			live += lua_isuserdata(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+	while (size < (live + 1) * 2) {
+		size *= 2;
+	}
+	entries = (InternEntry*)calloc(size, sizeof(InternEntry));
+	if (entries == NULL) {
+		return 0;
+	}
+	
+	for (i = 0; i < t->size; i++) {
+		InternEntry* e = &t->entries[i];
+		if (e->slot != 0) {
+			lua_rawgeti(L, cache, e->slot);
+			if (lua_isuserdata(L, -1)) {
+				*intern_lookup(entries, size, e->value, e->type) = *e;
+			} else {
+				intern_free_slot(t, e->slot);
+			}
+			lua_pop(L, 1);
+		}
+	}
+	free(t->entries);
+	t->entries = entries;
+	t->size = size;
+	t->count = live;
+	return 1;
+}
+
+static void push_integer64(lua_State* L, int64_t n, int8_t type) {
+	Int64Intern* t;
+	InternEntry* e;
+	int slot;
+	
+	lua_pushlightuserdata(L, &int64_intern_key);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	t = (Int64Intern*)lua_touserdata(L, -1);
+	if (t == NULL || t->entries == NULL) { // luaopen_i64lib not called yet
+		lua_pop(L, 1);
+		push_box(L, n, type);
+		return;
+	}
+	lua_getfenv(L, -1);
+	lua_remove(L, -2);
+	
+	e = intern_lookup(t->entries, t->size, n, type);
+	if (e->slot != 0) {
+		lua_rawgeti(L, -1, e->slot);
+		if (lua_isuserdata(L, -1)) {
+			lua_remove(L, -2);
+			return;
+		}
+		lua_pop(L, 1);
+		slot = e->slot;
+	} else {
+		if ((t->count + 1) * 4 > t->size * 3) {
+			if (!intern_rebuild(L, t, lua_gettop(L))) {
+				lua_pop(L, 1);
+				push_box(L, n, type);
+				return;
+			}
+			e = intern_lookup(t->entries, t->size, n, type);
+		}
+		slot = t->free_count > 0 ? t->free_slots[--t->free_count] : ++t->next_slot;
+		e->value = n;
+		e->type = type;
+		e->slot = slot;
+		t->count++;
+	}
+	
+	push_box(L, n, type);
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, -3, slot);
+	lua_remove(L, -2);
+}
+
+static int int64_intern_gc(lua_State* L) {
+	Int64Intern* t = (Int64Intern*)lua_touserdata(L, 1);
+	free(t->entries);
+	free(t->free_slots);
+	t->entries = NULL;
+	t->free_slots = NULL;
+	return 0;
+}
+
+LUALIB_API void lua_pushint64(lua_State* L, int64_t n) {
+	push_integer64(L, n, Int);
 }
 
 LUALIB_API int lua_isint64(lua_State* L, int pos) {
@@ -119,12 +270,7 @@ LUALIB_API int64_t lua_toint64(lua_State* L, int pos) {
 
 #if defined(UINT_ESPECIALLY)
 LUALIB_API void lua_pushuint64(lua_State* L, uint64_t n) {
-	Integer64* p = (Integer64*)lua_newuserdata(L, sizeof(Integer64));
-	p->fake_id = -1;
-	p->data.u64 = n;
-	p->type = UInt;
-	lua_rawgeti(L, LUA_REGISTRYINDEX, INT64_META_REF);
-	lua_setmetatable(L, -2);            
+	push_integer64(L, (int64_t)n, UInt);
 }
 
 
@@ -400,6 +546,73 @@ LUALIB_API uint64_t lua_touint64(lua_State* L, int pos) {
 }
 #endif
 
+// signed (unsigned for uint64 under UINT_ESPECIALLY) compare of two int64 or numbers without boxing anything
+static int int64_cmp(lua_State* L) {
+#if LUA_VERSION_NUM == 501
+	Integer64 lhs = lua_checkinteger64(L, 1);
+	Integer64 rhs = lua_checkinteger64(L, 2);
+	
+	if (lhs.type != rhs.type && lhs.type != Num && rhs.type != Num) {
+		return luaL_error(L, "type not match, lhs is %s, rhs is %s", lhs.type == Int ? "Int64" : "UInt64", rhs.type == Int ? "Int64" : "UInt64");
+	} else if (lhs.type == UInt || rhs.type == UInt) {
+		return lhs.data.u64 == rhs.data.u64 ? 0 : (lhs.data.u64 < rhs.data.u64 ? -1 : 1);
+	} else {
+		return lhs.data.i64 == rhs.data.i64 ? 0 : (lhs.data.i64 < rhs.data.i64 ? -1 : 1);
+	}
+#else
+	lua_Integer lhs = luaL_checkinteger(L, 1);
+	lua_Integer rhs = luaL_checkinteger(L, 2);
+	return lhs == rhs ? 0 : (lhs < rhs ? -1 : 1);
+#endif
+}
+
+static int int64_compare(lua_State* L) {
+	lua_pushinteger(L, int64_cmp(L));
+	return 1;
+}
+
+static int int64_equals(lua_State* L) {
+	lua_pushboolean(L, int64_cmp(L) == 0);
+	return 1;
+}
+
+static int int64_less(lua_State* L) {
+	lua_pushboolean(L, int64_cmp(L) < 0);
+	return 1;
+}
+
+static int int64_lessequal(lua_State* L) {
+	lua_pushboolean(L, int64_cmp(L) <= 0);
+	return 1;
+}
+
+// a value that keys a table the same way for equal ids, boxed or not: the number itself while it is exact in a double,
+// else its 8 bytes as a string, which is only allocated the first time that id is seen
+static int int64_key(lua_State* L) {
+#if LUA_VERSION_NUM == 501
+	int64_t n = lua_checkinteger64(L, 1).data.i64;
+	
+	if (n >= -(INT64_C(1) << 53) && n <= (INT64_C(1) << 53)) {
+		lua_pushnumber(L, (lua_Number)n);
+	} else {
+		lua_pushlstring(L, (const char*)&n, sizeof(n));
+	}
+#else
+	lua_pushinteger(L, luaL_checkinteger(L, 1));
+#endif
+	return 1;
+}
+
+static int int64_tonumber(lua_State* L) {
+#if LUA_VERSION_NUM == 501
+	Integer64 n = lua_checkinteger64(L, 1);
+	lua_pushnumber(L, n.type == UInt ? (lua_Number)n.data.u64 : (lua_Number)n.data.i64);
+#else
+	lua_pushnumber(L, (lua_Number)luaL_checkinteger(L, 1));
+#endif
+	return 1;
+}
+
 static int uint64_tostring(lua_State* L) {
 	char temp[72];
 	uint64_t n = lua_touint64(L, 1);
@@ -451,6 +664,8 @@ LUALIB_API int uint64_parse(lua_State* L)
 LUALIB_API int luaopen_i64lib(lua_State* L)
 {
 #if LUA_VERSION_NUM == 501
+	Int64Intern* intern;
+	
     lua_newtable(L);
 	
     lua_pushcfunction(L, int64_add);
@@ -487,7 +702,46 @@ LUALIB_API int luaopen_i64lib(lua_State* L)
     lua_setfield(L, -2, "__le");
 	
 	lua_rawseti(L, LUA_REGISTRYINDEX, INT64_META_REF);
+	
+	lua_pushlightuserdata(L, &int64_intern_key);
+	intern = (Int64Intern*)lua_newuserdata(L, sizeof(Int64Intern));
+	memset(intern, 0, sizeof(Int64Intern));
+	lua_newtable(L);
+	lua_pushcfunction(L, int64_intern_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushstring(L, "v");
+	lua_setfield(L, -2, "__mode");
+	lua_setmetatable(L, -2);
+	lua_setfenv(L, -2);
+	intern->entries = (InternEntry*)calloc(INT64_INTERN_MIN_SIZE, sizeof(InternEntry));
+	intern->size = INT64_INTERN_MIN_SIZE;
+	lua_rawset(L, LUA_REGISTRYINDEX);
 #endif
+	lua_newtable(L);
+	
+	lua_pushcfunction(L, int64_compare);
+	lua_setfield(L, -2, "compare");
+	
+	lua_pushcfunction(L, int64_equals);
+	lua_setfield(L, -2, "equals");
+	
+	lua_pushcfunction(L, int64_less);
+	lua_setfield(L, -2, "less");
+	
+	lua_pushcfunction(L, int64_lessequal);
+	lua_setfield(L, -2, "lessequal");
+	
+	lua_pushcfunction(L, int64_key);
+	lua_setfield(L, -2, "key");
+	
+	lua_pushcfunction(L, int64_tonumber);
+	lua_setfield(L, -2, "tonumber");
+	
+	lua_setglobal(L, "int64");
+	
     lua_newtable(L);
 	
 	lua_pushcfunction(L, uint64_tostring);
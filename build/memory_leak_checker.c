@@ -11,16 +11,30 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ltable.h"
 #include "lstate.h"
 #include "lobject.h"
 #include "lapi.h"
 #include "lgc.h"
+#include "lfunc.h"
+#include "lstring.h"
+#include "ltm.h"
 
 #define gnodelast(h)	gnode(h, cast(size_t, sizenode(h)))
 
+#if LUA_VERSION_NUM >= 504
+#define TAG_LCL LUA_VLCL
+#define TAG_CCL LUA_VCCL
+#else
+#define TAG_LCL LUA_TLCL
+#define TAG_CCL LUA_TCCL
+#endif
+
 static int table_size (Table *h, int fast)
 {
 	if (fast)
@@ -48,7 +62,8 @@ static int table_size (Table *h, int fast)
 
 typedef void (*TableSizeReport) (const void *p, int size);
 
-// type: 1: value of table(key is string), 2: value of table(key is number), 3: key of table, 4: metatable of table, 5: upvalue of closure
+// type: 1: value of table(key is string), 2: value of table(key is number), 3: key of table, 4: metatable of table, 5: upvalue of closure,
+// 6: upvalue of c closure(d is the index), 7: metatable of userdata, 8: uservalue of userdata(d is the index), 9: stack slot of thread(d is the slot)
 typedef void (*ObjectRelationshipReport) (const void *parent, const void *child, int type, const char *key, double d, const char *key2);
 
 LUA_API void xlua_report_table_size(lua_State *L, TableSizeReport cb, int fast)
@@ -66,27 +81,351 @@ LUA_API void xlua_report_table_size(lua_State *L, TableSizeReport cb, int fast)
 }
 
 
-static void report_table(Table *h, ObjectRelationshipReport cb)
+typedef struct HeapEdge {
+	const void *parent;
+	const void *child;
+	double d;
+	int type; // 0: size of table(size in d), others same as ObjectRelationshipReport
+	int key; // offset in the string buffer, -1 if none
+	int key2;
+} HeapEdge;
+
+#define HEAPWALK_EDGES 1
+#define HEAPWALK_TABLE_SIZES 2
+#define HEAPWALK_FAST_SIZE 4
+#define HEAPWALK_SNAPSHOT 8
+
+/*
+** binary heap snapshot, native byte order, laid out with no implicit padding:
+**   SnapshotHeader
+**   SnapshotObject[object_count]
+**   SnapshotEdge[edge_count] (type as HeapEdge, key/key2 index the interned strings, -1 if none)
+**   string_bytes of '\0' terminated strings, the i-th one is string i
+** an id is the address of the object in the state the snapshot was taken from
+*/
+#define SNAPSHOT_MAGIC "XLHS"
+#define SNAPSHOT_VERSION 1
+
+typedef struct SnapshotHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t object_count;
+	uint32_t edge_count;
+	uint32_t string_count;
+	uint32_t string_bytes;
+	uint64_t registry;
+	uint64_t global;
+} SnapshotHeader;
+
+typedef struct SnapshotObject {
+	uint64_t id;
+	uint32_t bytes; // approximate size of the object itself
+	uint32_t count; // entries of a table
+	uint32_t type; // gc tag with variant bits
+	uint32_t reserved;
+} SnapshotObject;
+
+typedef struct SnapshotEdge {
+	uint64_t parent;
+	uint64_t child;
+	double d;
+	uint32_t type;
+	int32_t key;
+	int32_t key2;
+	uint32_t reserved;
+} SnapshotEdge;
+
+typedef struct HeapSnapshot {
+	SnapshotHeader header;
+	SnapshotObject *objects;
+	int object_capacity;
+	SnapshotEdge *edges;
+	int edge_capacity;
+	char *strings;
+	int string_capacity;
+	int *string_offsets;
+	int offset_capacity;
+	int *string_slots; // open addressing, index + 1 of the interned string, 0 if empty
+	int slot_capacity;
+	char *serialized;
+	int oom;
+} HeapSnapshot;
+
+typedef struct HeapWalker {
+	GCObject *next; // next object to visit, anchored as uservalue of the walker userdata
+	int list; // 0: allgc, 1: finobj, 2: finished
+	int flags;
+	HeapEdge *edges;
+	int edge_count;
+	int edge_capacity;
+	char *strings;
+	int string_size;
+	int string_capacity;
+	int last_string; // consecutive upvalue edges share the source name of their closure
+	int oom;
+	HeapSnapshot *snapshot; // records go to the snapshot instead of the buffers
+} HeapWalker;
+
+LUA_API void *xlua_global_pointer(lua_State *L);
+
+static int grow(void **p, int *capacity, int need, size_t size, int initial)
+{
+	int n = *capacity == 0 ? initial : *capacity;
+	void *np;
+	if (need <= *capacity)
+	{
+		return 1;
+	}
+	while (n < need)
+	{
+		n *= 2;
+	}
+	np = realloc(*p, n * size);
+	if (np == NULL)
+	{
+		return 0;
+	}
+	*p = np;
+	*capacity = n;
+	return 1;
+}
+
+static unsigned int string_hash(const char *str)
+{
+	unsigned int h = 2166136261u;
+	for (; *str; str++)
+	{
+		h = (h ^ (unsigned char)*str) * 16777619u;
+	}
+	return h;
+}
+
+static int snapshot_rehash(HeapSnapshot *snap, int capacity)
+{
+	int *slots = (int *)calloc(capacity, sizeof(int));
+	uint32_t i;
+	if (slots == NULL)
+	{
+		return 0;
+	}
+	for (i = 0; i < snap->header.string_count; i++)
+	{
+		unsigned int h = string_hash(snap->strings + snap->string_offsets[i]) & (capacity - 1);
+		while (slots[h] != 0)
+		{
+			h = (h + 1) & (capacity - 1);
+		}
+		slots[h] = (int)i + 1;
+	}
+	free(snap->string_slots);
+	snap->string_slots = slots;
+	snap->slot_capacity = capacity;
+	return 1;
+}
+
+static int snapshot_string(HeapSnapshot *snap, const char *str)
+{
+	unsigned int h;
+	int len, index;
+	if (str == NULL)
+	{
+		return -1;
+	}
+	if ((int)snap->header.string_count * 2 >= snap->slot_capacity
+		&& !snapshot_rehash(snap, snap->slot_capacity == 0 ? 256 : snap->slot_capacity * 2))
+	{
+		snap->oom = 1;
+		return -1;
+	}
+	h = string_hash(str) & (snap->slot_capacity - 1);
+	while (snap->string_slots[h] != 0)
+	{
+		index = snap->string_slots[h] - 1;
+		if (strcmp(snap->strings + snap->string_offsets[index], str) == 0)
+		{
+			return index;
+		}
+		h = (h + 1) & (snap->slot_capacity - 1);
+	}
+	len = (int)strlen(str) + 1;
+	if (!grow((void **)&snap->strings, &snap->string_capacity, snap->header.string_bytes + len, 1, 4096)
+		|| !grow((void **)&snap->string_offsets, &snap->offset_capacity, snap->header.string_count + 1, sizeof(int), 256))
+	{
+		snap->oom = 1;
+		return -1;
+	}
+	memcpy(snap->strings + snap->header.string_bytes, str, len);
+	index = (int)snap->header.string_count++;
+	snap->string_offsets[index] = (int)snap->header.string_bytes;
+	snap->header.string_bytes += len;
+	snap->string_slots[h] = index + 1;
+	return index;
+}
+
+static void snapshot_edge(HeapSnapshot *snap, const void *parent, const void *child, int type, const char *key, double d, const char *key2)
+{
+	SnapshotEdge *edge;
+	if (!grow((void **)&snap->edges, &snap->edge_capacity, snap->header.edge_count + 1, sizeof(SnapshotEdge), 1024))
+	{
+		snap->oom = 1;
+		return;
+	}
+	edge = &snap->edges[snap->header.edge_count++];
+	edge->parent = (uint64_t)(size_t)parent;
+	edge->child = (uint64_t)(size_t)child;
+	edge->d = d;
+	edge->type = (uint32_t)type;
+	edge->key = snapshot_string(snap, key);
+	edge->key2 = snapshot_string(snap, key2);
+	edge->reserved = 0;
+}
+
+LUA_API void xlua_snapshot_free(HeapSnapshot *snap)
+{
+	if (snap != NULL)
+	{
+		free(snap->objects);
+		free(snap->edges);
+		free(snap->strings);
+		free(snap->string_offsets);
+		free(snap->string_slots);
+		free(snap->serialized);
+		free(snap);
+	}
+}
+
+// edges go to the callback of the one shot report, or to the buffer of a heap walker
+typedef struct EdgeSink {
+	ObjectRelationshipReport cb;
+	HeapWalker *walker;
+	global_State *g;
+	int strings; // strings are leaves, only a snapshot (for the retained sizes) wants edges to them
+} EdgeSink;
+
+static void sink_init(EdgeSink *sink, lua_State *L, ObjectRelationshipReport cb, HeapWalker *walker)
+{
+	sink->cb = cb;
+	sink->walker = walker;
+	sink->g = G(L);
+	sink->strings = walker != NULL && walker->snapshot != NULL;
+}
+
+static int walker_string(HeapWalker *w, const char *str)
+{
+	int len, offset;
+	if (str == NULL)
+	{
+		return -1;
+	}
+	if (w->last_string >= 0 && strcmp(w->strings + w->last_string, str) == 0)
+	{
+		return w->last_string;
+	}
+	len = (int)strlen(str) + 1;
+	if (w->string_size + len > w->string_capacity)
+	{
+		int capacity = w->string_capacity == 0 ? 4096 : w->string_capacity;
+		char *strings;
+		while (w->string_size + len > capacity)
+		{
+			capacity *= 2;
+		}
+		strings = (char *)realloc(w->strings, capacity);
+		if (strings == NULL)
+		{
+			w->oom = 1;
+			return -1;
+		}
+		w->strings = strings;
+		w->string_capacity = capacity;
+	}
+	offset = w->string_size;
+	memcpy(w->strings + offset, str, len);
+	w->string_size += len;
+	w->last_string = offset;
+	return offset;
+}
+
+static void walker_edge(HeapWalker *w, const void *parent, const void *child, int type, int key, double d, int key2)
+{
+	HeapEdge *edge;
+	if (w->edge_count == w->edge_capacity)
+	{
+		int capacity = w->edge_capacity == 0 ? 1024 : w->edge_capacity * 2;
+		HeapEdge *edges = (HeapEdge *)realloc(w->edges, capacity * sizeof(HeapEdge));
+		if (edges == NULL)
+		{
+			w->oom = 1;
+			return;
+		}
+		w->edges = edges;
+		w->edge_capacity = capacity;
+	}
+	edge = &w->edges[w->edge_count++];
+	edge->parent = parent;
+	edge->child = child;
+	edge->d = d;
+	edge->type = type;
+	edge->key = key;
+	edge->key2 = key2;
+}
+
+static void emit(EdgeSink *sink, const void *parent, const void *child, int type, const char *key, double d, const char *key2)
+{
+	if (sink->cb != NULL)
+	{
+		sink->cb(parent, child, type, key, d, key2);
+	}
+	else if (sink->walker->snapshot != NULL)
+	{
+		snapshot_edge(sink->walker->snapshot, parent, child, type, key, d, key2);
+	}
+	else
+	{
+		HeapWalker *w = sink->walker;
+		walker_edge(w, parent, child, type, walker_string(w, key), d, walker_string(w, key2));
+	}
+}
+
+static void emit_value(EdgeSink *sink, const void *parent, const TValue *v, int type, const char *key, double d, const char *key2)
+{
+	if (iscollectable(v) && (sink->strings || !ttisstring(v)))
+	{
+		emit(sink, parent, gcvalue(v), type, key, d, key2);
+	}
+}
+
+// a weak reference does not retain, edges through it would be false leads
+static void table_weakness(EdgeSink *sink, Table *h, int *weakkey, int *weakvalue)
+{
+	const TValue *mode = gfasttm(sink->g, h->metatable, TM_MODE);
+	*weakkey = *weakvalue = 0;
+	if (mode != NULL && ttisstring(mode))
+	{
+		*weakkey = strchr(svalue(mode), 'k') != NULL;
+		*weakvalue = strchr(svalue(mode), 'v') != NULL;
+	}
+}
+
+static void report_table(Table *h, EdgeSink *sink)
 {
 	Node *n, *limit = gnodelast(h);
     unsigned int i;
+	int weakkey, weakvalue;
 	
 	if (h->metatable != NULL)
 	{
-		cb(h, h->metatable, 4, NULL, 0, NULL);
+		emit(sink, h, h->metatable, 4, NULL, 0, NULL);
 	}
+	table_weakness(sink, h, &weakkey, &weakvalue);
 
 #if LUA_VERSION_NUM >= 504
-    for (i = 0; i < h->alimit; i++)
+    for (i = 0; i < h->alimit && !weakvalue; i++)
 #else
-	for (i = 0; i < h->sizearray; i++)
+	for (i = 0; i < h->sizearray && !weakvalue; i++)
 #endif
 	{
-		const TValue *item = &h->array[i];
-		if (ttistable(item))
-		{
-		    cb(h, gcvalue(item), 2, NULL, i + 1, NULL);
-		}
+		emit_value(sink, h, &h->array[i], 2, NULL, i + 1, NULL);
 	}
 
     for (n = gnode(h, 0); n < limit; n++)
@@ -94,105 +433,1258 @@ static void report_table(Table *h, ObjectRelationshipReport cb)
         if (!ttisnil(gval(n)))
         {
 #if LUA_VERSION_NUM >= 504
-			const TValue* key = (const TValue *)&(n->u.key_val);
+			TValue node_key;
+			const TValue* key = &node_key;
+			node_key.value_ = n->u.key_val; // key_val alone has no type tag
+			node_key.tt_ = n->u.key_tt;
 #else
             const TValue *key = gkey(n);
 #endif
-			if (ttistable(key))
+			if (!weakkey)
 			{
-				cb(h, gcvalue(key), 3, NULL, 0, NULL);
+				emit_value(sink, h, key, 3, NULL, 0, NULL);
 			}
             const TValue *value = gval(n);
-			if (ttistable(value))
+			if (weakvalue)
 			{
-				if (ttisstring(key))
-				{
-					cb(h, gcvalue(value), 1, getstr(tsvalue(key)), 0, NULL);
-				}
-				else if(ttisnumber(key))
-				{
-					cb(h, gcvalue(value), 2, NULL, nvalue(key), NULL);
-				}
-				else
-				{
-					// ???
+				continue;
+			}
+			if (ttisstring(key))
+			{
+				emit_value(sink, h, value, 1, getstr(tsvalue(key)), 0, NULL);
+			}
+			else if(ttisnumber(key))
+			{
+				emit_value(sink, h, value, 2, NULL, nvalue(key), NULL);
+			}
+			else
+			{
+				// ???
 #if LUA_VERSION_NUM >= 504
-					cb(h, gcvalue(value), 1, NULL, novariant(key->tt_), NULL);
+				emit_value(sink, h, value, 1, NULL, novariant(key->tt_), NULL);
 #else
-					cb(h, gcvalue(value), 1, NULL, ttnov(key), NULL);
+				emit_value(sink, h, value, 1, NULL, ttnov(key), NULL);
 #endif
-				}
 			}
 		}
     }
 }
 
+static void push_gcobject(lua_State *L, GCObject *o)
+{
+	lua_lock(L);
+#if LUA_VERSION_NUM >= 504 && LUA_VERSION_RELEASE_NUM >= 50406
+	setgcovalue(L, s2v(L->top.p), o);
+#elif LUA_VERSION_NUM >= 504
+	setgcovalue(L, s2v(L->top), o);
+#else
+	setgcovalue(L, L->top, o);
+#endif
+	api_incr_top(L);
+	lua_unlock(L);
+}
 
-LUA_API void xlua_report_object_relationship(lua_State *L, ObjectRelationshipReport cb)
+static const TValue *top_value(lua_State *L)
+{
+#if LUA_VERSION_NUM >= 504 && LUA_VERSION_RELEASE_NUM >= 50406
+	return s2v(L->top.p - 1);
+#elif LUA_VERSION_NUM >= 504
+	return s2v(L->top - 1);
+#else
+	return L->top - 1;
+#endif
+}
+
+static void report_closure(lua_State *L, LClosure *cl, EdgeSink *sink)
 {
-	GCObject *p = G(L)->allgc;
 	lua_Debug ar;
 	int i;
 	const char *name;
+
+	push_gcobject(L, obj2gco(cl));
+	lua_pushvalue(L, -1);
 	
-	while (p != NULL)
+	lua_getinfo(L, ">S", &ar);
+	
+	for (i=1;;i++)
 	{
-		if (p->tt == LUA_TTABLE)
+		name = lua_getupvalue(L,-1,i);
+		if (name == NULL)
+			break;
+		
+		if (*name != '\0')
 		{
-			Table *h = gco2t(p);
-			report_table(h, cb);
+			emit_value(sink, cl, top_value(L), 5, ar.short_src, ar.linedefined, name);
+		}
+		lua_pop(L, 1);
+	}
+	
+	lua_pop(L, 1);
+}
+
+// csharp_function_wrap and the other closures made by xlua.c keep their state in c upvalues
+static void report_cclosure(CClosure *cl, EdgeSink *sink)
+{
+	int i;
+	for (i = 0; i < cl->nupvalues; i++)
+	{
+		emit_value(sink, cl, &cl->upvalue[i], 6, NULL, i + 1, NULL);
+	}
+}
+
+static void report_userdata(Udata *u, EdgeSink *sink)
+{
+	if (u->metatable != NULL)
+	{
+		emit(sink, u, u->metatable, 7, NULL, 0, NULL);
+	}
+#if LUA_VERSION_NUM >= 504
+	{
+		int i;
+		for (i = 0; i < u->nuvalue; i++)
+		{
+			emit_value(sink, u, &u->uv[i].uv, 8, NULL, i + 1, NULL);
+		}
+	}
+#else
+	{
+		TValue uv;
+		uv.value_ = u->user_;
+		uv.tt_ = u->ttuv_;
+		emit_value(sink, u, &uv, 8, NULL, 1, NULL);
+	}
+#endif
+}
+
+// live part of the stack, locals of suspended coroutines are where their leaks hide
+static void report_thread(lua_State *th, EdgeSink *sink)
+{
+	StkId o;
+	int slot = 1;
+#if LUA_VERSION_NUM >= 504 && LUA_VERSION_RELEASE_NUM >= 50406
+	for (o = th->stack.p; o < th->top.p; o++, slot++)
+#else
+	for (o = th->stack; o < th->top; o++, slot++)
+#endif
+	{
+#if LUA_VERSION_NUM >= 504
+		emit_value(sink, th, s2v(o), 9, NULL, slot, NULL);
+#else
+		emit_value(sink, th, o, 9, NULL, slot, NULL);
+#endif
+	}
+}
+
+static void report_object(lua_State *L, GCObject *o, EdgeSink *sink)
+{
+	if (o->tt == LUA_TTABLE)
+	{
+		report_table(gco2t(o), sink);
+	}
+	else if (o->tt == TAG_LCL)
+	{
+		report_closure(L, gco2lcl(o), sink);
+	}
+	else if (o->tt == TAG_CCL)
+	{
+		report_cclosure(gco2ccl(o), sink);
+	}
+	else if (novariant(o->tt) == LUA_TUSERDATA)
+	{
+		report_userdata(gco2u(o), sink);
+	}
+	else if (novariant(o->tt) == LUA_TTHREAD)
+	{
+		report_thread(gco2th(o), sink);
+	}
+}
+
+LUA_API void xlua_report_object_relationship(lua_State *L, ObjectRelationshipReport cb)
+{
+	GCObject *p;
+	EdgeSink sink;
+	sink_init(&sink, L, cb, NULL);
+	
+	for (p = G(L)->allgc; p != NULL; p = p->next)
+	{
+		report_object(L, p, &sink);
+	}
+	for (p = G(L)->finobj; p != NULL; p = p->next)
+	{
+		report_object(L, p, &sink);
+	}
+#if LUA_VERSION_NUM < 504
+	report_thread(G(L)->mainthread, &sink); // 5.3 keeps it out of allgc
+#endif
+}
+
+/*
+** incremental heap walk: visits allgc then finobj a budget of objects per step, edges and table sizes are buffered
+** natively for the caller to drain between steps. between steps the next object to visit is kept alive by the
+** walker, so the collector may run (and free anything else) while the walk is spread over frames. objects created
+** during the walk are not visited, objects moved to another gc list meanwhile may be missed or visited twice.
+*/
+
+static void walker_free(HeapWalker *w)
+{
+	free(w->edges);
+	free(w->strings);
+	w->edges = NULL;
+	w->strings = NULL;
+	w->edge_count = w->edge_capacity = 0;
+	w->string_size = w->string_capacity = 0;
+	w->last_string = -1;
+	xlua_snapshot_free(w->snapshot);
+	w->snapshot = NULL;
+}
+
+static int walker_gc(lua_State *L)
+{
+	walker_free((HeapWalker *)lua_touserdata(L, 1));
+	return 0;
+}
+
+static uint32_t object_bytes(GCObject *o)
+{
+	size_t bytes;
+	switch (novariant(o->tt))
+	{
+		case LUA_TSTRING:
+			bytes = sizelstring(tsslen(gco2ts(o)));
+			break;
+		case LUA_TTABLE:
+		{
+			Table *h = gco2t(o);
+#ifdef allocsizenode
+			bytes = sizeof(Table) + sizeof(Node) * allocsizenode(h);
+#else
+			bytes = sizeof(Table) + sizeof(Node) * sizenode(h);
+#endif
+#if LUA_VERSION_NUM >= 504
+			bytes += sizeof(TValue) * luaH_realasize(h);
+#else
+			bytes += sizeof(TValue) * h->sizearray;
+#endif
+			break;
 		}
+		case LUA_TFUNCTION:
+			bytes = o->tt == TAG_LCL ? sizeLclosure(gco2lcl(o)->nupvalues) : sizeCclosure(gco2ccl(o)->nupvalues);
+			break;
+		case LUA_TUSERDATA:
 #if LUA_VERSION_NUM >= 504
-		else if (p->tt == LUA_VLCL)
+			bytes = sizeudata(gco2u(o)->nuvalue, gco2u(o)->len);
 #else
-		else if (p->tt == LUA_TLCL)
+			bytes = sizeludata(gco2u(o)->len);
 #endif
+			break;
+		case LUA_TTHREAD:
 		{
-			LClosure *cl = gco2lcl(p);
-			lua_lock(L);
+			lua_State *th = gco2th(o);
 #if LUA_VERSION_NUM >= 504 && LUA_VERSION_RELEASE_NUM >= 50406
-			setclLvalue2s(L, L->top.p, cl);
-#else
-			setclLvalue(L, L->top, cl);
-#endif
-			api_incr_top(L);
-			lua_unlock(L);
-			
-			lua_pushvalue(L, -1);
-			
-			lua_getinfo(L, ">S", &ar);
-			
-			for (i=1;;i++)
-			{
-				name = lua_getupvalue(L,-1,i);
-				if (name == NULL)
-					break;
-				const void *pv = lua_topointer(L, -1);
-				
-				if (*name != '\0' && LUA_TTABLE == lua_type(L, -1))
-				{
-					cb(cl, pv, 5, ar.short_src, ar.linedefined, name);
-				}
-				lua_pop(L, 1);
-			}
-			
-			lua_pop(L, 1);
+			bytes = sizeof(lua_State) + sizeof(StackValue) * (th->stack_last.p - th->stack.p);
+#elif LUA_VERSION_NUM >= 504
+			bytes = sizeof(lua_State) + sizeof(StackValue) * (th->stack_last - th->stack);
+#else
+			bytes = sizeof(lua_State) + sizeof(TValue) * th->stacksize;
+#endif
+			break;
 		}
-		p = p->next;
+		case LUA_TPROTO:
+		{
+			Proto *f = gco2p(o);
+			bytes = sizeof(Proto) + sizeof(Instruction) * f->sizecode + sizeof(TValue) * f->sizek + sizeof(Proto *) * f->sizep;
+			break;
+		}
+		default:
+			bytes = 0;
+			break;
 	}
+	return (uint32_t)bytes;
 }
 
-LUA_API void *xlua_registry_pointer(lua_State *L)
+static void snapshot_object(HeapSnapshot *snap, GCObject *o, int fast)
 {
-	return gcvalue(&G(L)->l_registry);
+	SnapshotObject *obj;
+	if (!grow((void **)&snap->objects, &snap->object_capacity, snap->header.object_count + 1, sizeof(SnapshotObject), 1024))
+	{
+		snap->oom = 1;
+		return;
+	}
+	obj = &snap->objects[snap->header.object_count++];
+	obj->id = (uint64_t)(size_t)o;
+	obj->bytes = object_bytes(o);
+	obj->count = o->tt == LUA_TTABLE ? (uint32_t)table_size(gco2t(o), fast) : 0;
+	obj->type = (uint32_t)(o->tt & 0x3F);
+	obj->reserved = 0;
 }
 
-LUA_API void *xlua_global_pointer(lua_State *L)
+// only objects a TValue can hold can be anchored, a dead one is about to be swept and must not be resurrected
+static int can_anchor(global_State *g, GCObject *o)
 {
-	Table *reg = hvalue(&G(L)->l_registry);
-	const TValue *global;
-    lua_lock(L);
-	global = luaH_getint(reg, LUA_RIDX_GLOBALS);
-	lua_unlock(L);
-	return gcvalue(global);
+	if (isdead(g, o))
+	{
+		return 0;
+	}
+	switch (novariant(o->tt))
+	{
+		case LUA_TSTRING:
+		case LUA_TTABLE:
+		case LUA_TFUNCTION:
+		case LUA_TUSERDATA:
+		case LUA_TTHREAD:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static void walker_anchor(lua_State *L, HeapWalker *w)
+{
+	lua_rawgetp(L, LUA_REGISTRYINDEX, w);
+	if (w->next != NULL)
+	{
+		push_gcobject(L, w->next);
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+#if LUA_VERSION_NUM >= 504
+	lua_setiuservalue(L, -2, 1);
+#else
+	lua_setuservalue(L, -2);
+#endif
+	lua_pop(L, 1);
+}
+
+LUA_API HeapWalker *xlua_heapwalk_begin(lua_State *L, int flags)
+{
+#if LUA_VERSION_NUM >= 504
+	HeapWalker *w = (HeapWalker *)lua_newuserdatauv(L, sizeof(HeapWalker), 1);
+#else
+	HeapWalker *w = (HeapWalker *)lua_newuserdata(L, sizeof(HeapWalker));
+#endif
+	memset(w, 0, sizeof(HeapWalker));
+	w->last_string = -1;
+	if (flags & HEAPWALK_SNAPSHOT)
+	{
+		flags |= HEAPWALK_EDGES;
+		w->snapshot = (HeapSnapshot *)calloc(1, sizeof(HeapSnapshot));
+		if (w->snapshot != NULL)
+		{
+			memcpy(w->snapshot->header.magic, SNAPSHOT_MAGIC, 4);
+			w->snapshot->header.version = SNAPSHOT_VERSION;
+			w->snapshot->header.registry = (uint64_t)(size_t)gcvalue(&G(L)->l_registry);
+			w->snapshot->header.global = (uint64_t)(size_t)xlua_global_pointer(L);
+		}
+		else
+		{
+			w->oom = 1;
+		}
+	}
+	w->flags = flags;
+	lua_newtable(L);
+	lua_pushcfunction(L, walker_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, w);
+	w->next = G(L)->allgc; // the walker itself is in front of the list
+	while (w->next != NULL && !can_anchor(G(L), w->next))
+	{
+		w->next = w->next->next;
+	}
+	walker_anchor(L, w);
+	return w;
+}
+
+// returns 1 if there are objects left to visit
+LUA_API int xlua_heapwalk_step(lua_State *L, HeapWalker *w, int budget)
+{
+	global_State *g = G(L);
+	GCObject *p = w->next;
+	EdgeSink sink;
+	sink_init(&sink, L, NULL, w);
+	
+	if (w->list > 1)
+	{
+		return 0;
+	}
+	lua_checkstack(L, 4);
+	for (;;)
+	{
+		if (p == NULL)
+		{
+			if (++w->list > 1)
+			{
+				break;
+			}
+#if LUA_VERSION_NUM < 504
+			if (w->snapshot != NULL) // 5.3 keeps the main thread out of allgc
+			{
+				snapshot_object(w->snapshot, obj2gco(g->mainthread), w->flags & HEAPWALK_FAST_SIZE);
+			}
+			if (w->flags & HEAPWALK_EDGES)
+			{
+				report_thread(g->mainthread, &sink);
+			}
+#endif
+			p = g->finobj;
+			continue;
+		}
+		if (budget <= 0 && can_anchor(g, p))
+		{
+			break;
+		}
+		budget--;
+		if (!isdead(g, p))
+		{
+			if (w->snapshot != NULL)
+			{
+				snapshot_object(w->snapshot, p, w->flags & HEAPWALK_FAST_SIZE);
+			}
+			if (p->tt == LUA_TTABLE && (w->flags & HEAPWALK_TABLE_SIZES))
+			{
+				walker_edge(w, p, NULL, 0, -1, table_size(gco2t(p), w->flags & HEAPWALK_FAST_SIZE), -1);
+			}
+			if (w->flags & HEAPWALK_EDGES)
+			{
+				report_object(L, p, &sink);
+			}
+		}
+		p = p->next;
+	}
+	w->next = p;
+	walker_anchor(L, w);
+	return w->list <= 1;
+}
+
+// edges buffered since the last clear, strings referenced by HeapEdge.key/key2 are in xlua_heapwalk_strings
+LUA_API const HeapEdge *xlua_heapwalk_edges(HeapWalker *w, int *count)
+{
+	*count = w->edge_count;
+	return w->edges;
+}
+
+LUA_API const char *xlua_heapwalk_strings(HeapWalker *w, int *size)
+{
+	*size = w->string_size;
+	return w->strings;
+}
+
+// 1 if some edges were dropped because a buffer could not grow
+LUA_API int xlua_heapwalk_overflowed(HeapWalker *w)
+{
+	return w->oom || (w->snapshot != NULL && w->snapshot->oom);
+}
+
+LUA_API void xlua_heapwalk_clear(HeapWalker *w)
+{
+	w->edge_count = 0;
+	w->string_size = 0;
+	w->last_string = -1;
+}
+
+// the snapshot of a HEAPWALK_SNAPSHOT walk, owned by the caller afterwards (xlua_snapshot_free)
+LUA_API HeapSnapshot *xlua_heapwalk_take_snapshot(HeapWalker *w)
+{
+	HeapSnapshot *snap = w->snapshot;
+	w->snapshot = NULL;
+	return snap;
+}
+
+LUA_API void xlua_heapwalk_end(lua_State *L, HeapWalker *w)
+{
+	w->next = NULL;
+	w->list = 2;
+	walker_anchor(L, w);
+	walker_free(w);
+	lua_pushnil(L);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, w);
+}
+
+LUA_API void *xlua_registry_pointer(lua_State *L)
+{
+	return gcvalue(&G(L)->l_registry);
+}
+
+LUA_API void *xlua_global_pointer(lua_State *L)
+{
+	Table *reg = hvalue(&G(L)->l_registry);
+	const TValue *global;
+    lua_lock(L);
+	global = luaH_getint(reg, LUA_RIDX_GLOBALS);
+	lua_unlock(L);
+	return gcvalue(global);
+}
+
+/*
+** snapshots: a whole heap walk kept natively, (de)serialized to the format described at SnapshotHeader, and diffed
+** offline, the objects that grew come with a retention path from the registry, the globals or an upvalue
+*/
+
+LUA_API HeapSnapshot *xlua_heap_snapshot(lua_State *L)
+{
+	HeapWalker *w = xlua_heapwalk_begin(L, HEAPWALK_SNAPSHOT);
+	HeapSnapshot *snap = NULL;
+	while (xlua_heapwalk_step(L, w, INT_MAX));
+	if (!xlua_heapwalk_overflowed(w))
+	{
+		snap = xlua_heapwalk_take_snapshot(w);
+	}
+	xlua_heapwalk_end(L, w);
+	return snap;
+}
+
+LUA_API const void *xlua_snapshot_serialize(HeapSnapshot *snap, int *size)
+{
+	size_t objects = sizeof(SnapshotObject) * snap->header.object_count;
+	size_t edges = sizeof(SnapshotEdge) * snap->header.edge_count;
+	size_t total = sizeof(SnapshotHeader) + objects + edges + snap->header.string_bytes;
+	char *buf;
+	if (total > INT_MAX)
+	{
+		return NULL;
+	}
+	buf = (char *)realloc(snap->serialized, total);
+	if (buf == NULL)
+	{
+		return NULL;
+	}
+	snap->serialized = buf;
+	memcpy(buf, &snap->header, sizeof(SnapshotHeader));
+	buf += sizeof(SnapshotHeader);
+	if (objects > 0)
+	{
+		memcpy(buf, snap->objects, objects);
+	}
+	buf += objects;
+	if (edges > 0)
+	{
+		memcpy(buf, snap->edges, edges);
+	}
+	buf += edges;
+	if (snap->header.string_bytes > 0)
+	{
+		memcpy(buf, snap->strings, snap->header.string_bytes);
+	}
+	*size = (int)total;
+	return snap->serialized;
+}
+
+// returns 1 on success
+LUA_API int xlua_snapshot_save(HeapSnapshot *snap, const char *path)
+{
+	int size;
+	const void *buf = xlua_snapshot_serialize(snap, &size);
+	FILE *f;
+	int ok;
+	if (buf == NULL || (f = fopen(path, "wb")) == NULL)
+	{
+		return 0;
+	}
+	ok = fwrite(buf, 1, size, f) == (size_t)size;
+	ok = fclose(f) == 0 && ok;
+	return ok;
+}
+
+// NULL if buf is not a snapshot of this version and byte order
+LUA_API HeapSnapshot *xlua_snapshot_load(const void *buf, int size)
+{
+	const char *p = (const char *)buf;
+	HeapSnapshot *snap;
+	SnapshotHeader header;
+	size_t objects, edges;
+	uint32_t i, offset;
+	if (size < (int)sizeof(SnapshotHeader))
+	{
+		return NULL;
+	}
+	memcpy(&header, p, sizeof(SnapshotHeader));
+	objects = sizeof(SnapshotObject) * (size_t)header.object_count;
+	edges = sizeof(SnapshotEdge) * (size_t)header.edge_count;
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0 || header.version != SNAPSHOT_VERSION
+		|| header.object_count > INT_MAX / sizeof(SnapshotObject) || header.edge_count > INT_MAX / sizeof(SnapshotEdge)
+		|| sizeof(SnapshotHeader) + objects + edges + header.string_bytes != (size_t)size
+		|| (header.string_bytes > 0 && p[size - 1] != '\0'))
+	{
+		return NULL;
+	}
+	snap = (HeapSnapshot *)calloc(1, sizeof(HeapSnapshot));
+	if (snap == NULL)
+	{
+		return NULL;
+	}
+	snap->header = header;
+	snap->header.string_count = 0;
+	p += sizeof(SnapshotHeader);
+	if (!grow((void **)&snap->objects, &snap->object_capacity, header.object_count + 1, sizeof(SnapshotObject), 1)
+		|| !grow((void **)&snap->edges, &snap->edge_capacity, header.edge_count + 1, sizeof(SnapshotEdge), 1)
+		|| !grow((void **)&snap->strings, &snap->string_capacity, header.string_bytes + 1, 1, 1))
+	{
+		xlua_snapshot_free(snap);
+		return NULL;
+	}
+	memcpy(snap->objects, p, objects);
+	memcpy(snap->edges, p + objects, edges);
+	memcpy(snap->strings, p + objects + edges, header.string_bytes);
+	for (offset = 0; offset < header.string_bytes; offset += (uint32_t)strlen(snap->strings + offset) + 1)
+	{
+		if (!grow((void **)&snap->string_offsets, &snap->offset_capacity, snap->header.string_count + 1, sizeof(int), 256))
+		{
+			xlua_snapshot_free(snap);
+			return NULL;
+		}
+		snap->string_offsets[snap->header.string_count++] = (int)offset;
+	}
+	for (i = 0; i < header.edge_count; i++) // out of range keys read as none
+	{
+		SnapshotEdge *edge = &snap->edges[i];
+		if (edge->key >= (int32_t)snap->header.string_count)
+		{
+			edge->key = -1;
+		}
+		if (edge->key2 >= (int32_t)snap->header.string_count)
+		{
+			edge->key2 = -1;
+		}
+	}
+	return snap;
+}
+
+LUA_API HeapSnapshot *xlua_snapshot_load_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	HeapSnapshot *snap = NULL;
+	char *buf = NULL;
+	long size;
+	if (f == NULL)
+	{
+		return NULL;
+	}
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && size <= INT_MAX && fseek(f, 0, SEEK_SET) == 0
+		&& (buf = (char *)malloc(size)) != NULL && fread(buf, 1, size, f) == (size_t)size)
+	{
+		snap = xlua_snapshot_load(buf, (int)size);
+	}
+	free(buf);
+	fclose(f);
+	return snap;
+}
+
+typedef struct HeapDiffEntry {
+	uint64_t id;
+	uint64_t retained; // bytes freed with the object, per the dominator tree
+	uint32_t type;
+	uint32_t bytes;
+	uint32_t count_from;
+	uint32_t count_to;
+	int32_t path; // offset in the string buffer of the diff, -1 if unreachable
+	uint32_t reserved;
+} HeapDiffEntry;
+
+typedef struct HeapDiff {
+	HeapDiffEntry *entries;
+	int count;
+	int capacity;
+	char *strings;
+	int string_size;
+	int string_capacity;
+} HeapDiff;
+
+typedef struct IdIndex {
+	uint64_t *ids;
+	int *indices;
+	int mask;
+} IdIndex;
+
+static int id_index_build(IdIndex *index, const HeapSnapshot *snap)
+{
+	int capacity = 16;
+	uint32_t i;
+	while (capacity < (int)snap->header.object_count * 2)
+	{
+		capacity *= 2;
+	}
+	index->mask = capacity - 1;
+	index->ids = (uint64_t *)malloc(sizeof(uint64_t) * capacity);
+	index->indices = (int *)malloc(sizeof(int) * capacity);
+	if (index->ids == NULL || index->indices == NULL)
+	{
+		return 0;
+	}
+	memset(index->indices, -1, sizeof(int) * capacity);
+	for (i = 0; i < snap->header.object_count; i++)
+	{
+		uint64_t id = snap->objects[i].id;
+		int h = (int)((id >> 3) * 2654435761u) & index->mask;
+		while (index->indices[h] >= 0 && index->ids[h] != id)
+		{
+			h = (h + 1) & index->mask;
+		}
+		index->ids[h] = id;
+		index->indices[h] = (int)i;
+	}
+	return 1;
+}
+
+static int id_index_get(const IdIndex *index, uint64_t id)
+{
+	int h = (int)((id >> 3) * 2654435761u) & index->mask;
+	while (index->indices[h] >= 0)
+	{
+		if (index->ids[h] == id)
+		{
+			return index->indices[h];
+		}
+		h = (h + 1) & index->mask;
+	}
+	return -1;
+}
+
+static void id_index_free(IdIndex *index)
+{
+	free(index->ids);
+	free(index->indices);
+}
+
+static int diff_append(HeapDiff *diff, const char *str, size_t len)
+{
+	if (!grow((void **)&diff->strings, &diff->string_capacity, diff->string_size + (int)len + 1, 1, 4096))
+	{
+		return 0;
+	}
+	memcpy(diff->strings + diff->string_size, str, len);
+	diff->string_size += (int)len;
+	diff->strings[diff->string_size] = '\0';
+	return 1;
+}
+
+static const char *snapshot_key(const HeapSnapshot *snap, int32_t key)
+{
+	return key >= 0 ? snap->strings + snap->string_offsets[key] : NULL;
+}
+
+static const char *root_name(const HeapSnapshot *snap, uint64_t id)
+{
+	return id == snap->header.global ? "_G" : "_R";
+}
+
+// same notation as LuaMemoryLeakChecker.MemoryLeakReport: _G.a.b[1], _R.x, @file.lua:local t.x
+static int diff_path(HeapDiff *diff, const HeapSnapshot *snap, const IdIndex *index, const int *pred, int obj)
+{
+	static const char *const type_names[] = {"nil", "boolean", "lightuserdata", "number", "string", "table", "function", "userdata", "thread"};
+	int start = diff->string_size, depth = 0, e, i;
+	int *chain = NULL, chain_capacity = 0;
+	const SnapshotEdge *edge;
+	char buf[64];
+
+	for (e = pred[obj]; e >= 0; e = pred[id_index_get(index, edge->parent)])
+	{
+		if (!grow((void **)&chain, &chain_capacity, depth + 1, sizeof(int), 16))
+		{
+			free(chain);
+			return -1;
+		}
+		chain[depth++] = e;
+		edge = &snap->edges[e];
+		if (edge->type == 5)
+		{
+			break;
+		}
+	}
+	if (depth == 0)
+	{
+		const char *root = root_name(snap, snap->objects[obj].id);
+		diff_append(diff, root, strlen(root));
+	}
+	for (i = depth - 1; i >= 0; i--)
+	{
+		const char *key, *key2;
+		edge = &snap->edges[chain[i]];
+		key = snapshot_key(snap, edge->key);
+		key2 = snapshot_key(snap, edge->key2);
+		if (i == depth - 1 && edge->type != 5)
+		{
+			const char *root = root_name(snap, edge->parent);
+			diff_append(diff, root, strlen(root));
+		}
+		switch (edge->type)
+		{
+			case 1:
+				if (key == NULL)
+				{
+					snprintf(buf, sizeof(buf), ".<%s>", edge->d >= 0 && edge->d < 9 ? type_names[(int)edge->d] : "?");
+					key = buf;
+				}
+				else
+				{
+					diff_append(diff, ".", 1);
+				}
+				diff_append(diff, key, strlen(key));
+				break;
+			case 2:
+				snprintf(buf, sizeof(buf), "[%.14g]", edge->d);
+				diff_append(diff, buf, strlen(buf));
+				break;
+			case 3:
+				diff_append(diff, ".!KEY!", 6);
+				break;
+			case 4:
+			case 7:
+				diff_append(diff, ".__metatable", 12);
+				break;
+			case 6:
+				snprintf(buf, sizeof(buf), ".<upvalue %d>", (int)edge->d);
+				diff_append(diff, buf, strlen(buf));
+				break;
+			case 8:
+				snprintf(buf, sizeof(buf), ".<uservalue %d>", (int)edge->d);
+				diff_append(diff, buf, strlen(buf));
+				break;
+			case 9:
+				snprintf(buf, sizeof(buf), ".<stack %d>", (int)edge->d);
+				diff_append(diff, buf, strlen(buf));
+				break;
+			case 5:
+				snprintf(buf, sizeof(buf), ":%d:local ", (int)edge->d);
+				diff_append(diff, key ? key : "?", key ? strlen(key) : 1);
+				diff_append(diff, buf, strlen(buf));
+				diff_append(diff, key2 ? key2 : "?", key2 ? strlen(key2) : 1);
+				break;
+			default:
+				snprintf(buf, sizeof(buf), ".<edge %u>", edge->type);
+				diff_append(diff, buf, strlen(buf));
+				break;
+		}
+	}
+	free(chain);
+	if (diff->string_size == start && !diff_append(diff, "", 0))
+	{
+		return -1;
+	}
+	diff->string_size++; // keep the terminator
+	return start;
+}
+
+/*
+** breadth first from the globals and the registry (the main thread is _R[1]), then from the values held by upvalues,
+** so the recorded predecessor edge of an object is on one of its shortest retention paths
+*/
+static int *retention_tree(const HeapSnapshot *snap, const IdIndex *index)
+{
+	int n = (int)snap->header.object_count;
+	int *pred = (int *)malloc(sizeof(int) * n);
+	int *queue = (int *)malloc(sizeof(int) * n);
+	int *first = (int *)calloc(n + 1, sizeof(int));
+	int *adjacent = (int *)malloc(sizeof(int) * (snap->header.edge_count + 1));
+	int head = 0, tail = 0, roots, upvalues_queued = 0, i, e;
+	uint32_t k;
+	if (pred == NULL || queue == NULL || first == NULL || adjacent == NULL)
+	{
+		free(pred);
+		pred = NULL;
+		goto cleanup;
+	}
+	for (k = 0; k < snap->header.edge_count; k++)
+	{
+		int parent = id_index_get(index, snap->edges[k].parent);
+		if (parent >= 0)
+		{
+			first[parent + 1]++;
+		}
+	}
+	for (i = 0; i < n; i++)
+	{
+		first[i + 1] += first[i];
+		pred[i] = -1;
+	}
+	for (k = 0; k < snap->header.edge_count; k++)
+	{
+		int parent = id_index_get(index, snap->edges[k].parent);
+		if (parent >= 0)
+		{
+			adjacent[first[parent]++] = (int)k;
+		}
+	}
+	for (i = n; i > 0; i--) // first[] was advanced to the end of each run
+	{
+		first[i] = first[i - 1];
+	}
+	first[0] = 0;
+
+	if ((i = id_index_get(index, snap->header.global)) >= 0)
+	{
+		pred[i] = -2;
+		queue[tail++] = i;
+	}
+	if ((i = id_index_get(index, snap->header.registry)) >= 0 && pred[i] == -1)
+	{
+		pred[i] = -2;
+		queue[tail++] = i;
+	}
+	roots = tail;
+	for (;;)
+	{
+		if (head == roots && !upvalues_queued)
+		{
+			upvalues_queued = 1;
+			for (k = 0; k < snap->header.edge_count; k++)
+			{
+				if (snap->edges[k].type == 5 && (i = id_index_get(index, snap->edges[k].child)) >= 0 && pred[i] == -1)
+				{
+					pred[i] = (int)k;
+					queue[tail++] = i;
+				}
+			}
+		}
+		if (head == tail)
+		{
+			break;
+		}
+		i = queue[head++];
+		for (e = first[i]; e < first[i + 1]; e++)
+		{
+			int child = id_index_get(index, snap->edges[adjacent[e]].child);
+			if (child >= 0 && pred[child] == -1)
+			{
+				pred[child] = adjacent[e];
+				queue[tail++] = child;
+			}
+		}
+	}
+cleanup:
+	free(queue);
+	free(first);
+	free(adjacent);
+	return pred;
+}
+
+/*
+** dominator tree (the iterative algorithm of Cooper, Harvey and Kennedy) under a virtual root holding the globals,
+** the registry and every object no recorded edge points to, retained[i] sums the bytes of the subtree of object i
+*/
+static uint64_t *retained_sizes(const HeapSnapshot *snap, const IdIndex *index)
+{
+	int n = (int)snap->header.object_count, root = n;
+	int *parents = (int *)malloc(sizeof(int) * (snap->header.edge_count + 1));
+	int *children = (int *)malloc(sizeof(int) * (snap->header.edge_count + n + 2));
+	int *first_parent = (int *)calloc(n + 2, sizeof(int));
+	int *first_child = (int *)calloc(n + 2, sizeof(int));
+	int *post = (int *)malloc(sizeof(int) * (n + 1));
+	int *order = (int *)malloc(sizeof(int) * (n + 1));
+	int *idom = (int *)malloc(sizeof(int) * (n + 1));
+	int *stack = (int *)malloc(sizeof(int) * (n + 1) * 2);
+	uint64_t *retained = (uint64_t *)malloc(sizeof(uint64_t) * (n + 1));
+	char *from_root = (char *)malloc(n + 1);
+	int i, k, count = 0, sp = 0, changed;
+	uint32_t e;
+	if (parents == NULL || children == NULL || first_parent == NULL || first_child == NULL || post == NULL
+		|| order == NULL || idom == NULL || stack == NULL || retained == NULL || from_root == NULL)
+	{
+		free(retained);
+		retained = NULL;
+		goto cleanup;
+	}
+	for (e = 0; e < snap->header.edge_count; e++)
+	{
+		int parent = id_index_get(index, snap->edges[e].parent), child = id_index_get(index, snap->edges[e].child);
+		if (parent >= 0 && child >= 0)
+		{
+			first_child[parent + 1]++;
+			first_parent[child + 1]++;
+		}
+	}
+	for (i = 0; i < n; i++)
+	{
+		from_root[i] = first_parent[i + 1] == 0 || snap->objects[i].id == snap->header.global
+			|| snap->objects[i].id == snap->header.registry;
+		first_child[root + 1] += from_root[i];
+	}
+	for (i = 0; i <= n; i++)
+	{
+		first_child[i + 1] += first_child[i];
+		first_parent[i + 1] += first_parent[i];
+	}
+	for (e = 0; e < snap->header.edge_count; e++)
+	{
+		int parent = id_index_get(index, snap->edges[e].parent), child = id_index_get(index, snap->edges[e].child);
+		if (parent >= 0 && child >= 0)
+		{
+			children[first_child[parent]++] = child;
+			parents[first_parent[child]++] = parent;
+		}
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (from_root[i])
+		{
+			children[first_child[root]++] = i;
+		}
+	}
+	for (i = n + 1; i > 0; i--) // both were advanced to the end of each run
+	{
+		first_child[i] = first_child[i - 1];
+		first_parent[i] = first_parent[i - 1];
+	}
+	first_child[0] = first_parent[0] = 0;
+
+	// postorder by an explicit stack of (node, next child)
+	for (i = 0; i <= n; i++)
+	{
+		post[i] = -1;
+		idom[i] = -1;
+	}
+	post[root] = -2;
+	stack[sp++] = root;
+	stack[sp++] = first_child[root];
+	while (sp > 0)
+	{
+		int node = stack[sp - 2], next = stack[sp - 1];
+		if (next < first_child[node + 1])
+		{
+			int child = children[next];
+			stack[sp - 1] = next + 1;
+			if (post[child] == -1)
+			{
+				post[child] = -2;
+				stack[sp++] = child;
+				stack[sp++] = first_child[child];
+			}
+		}
+		else
+		{
+			post[node] = count;
+			order[count++] = node;
+			sp -= 2;
+		}
+	}
+
+	idom[root] = root;
+	do
+	{
+		changed = 0;
+		for (k = count - 2; k >= 0; k--) // reverse postorder, the root is last in postorder
+		{
+			int node = order[k], new_idom = from_root[node] ? root : -1, p;
+			for (p = first_parent[node]; p < first_parent[node + 1]; p++)
+			{
+				int pred = parents[p];
+				if (idom[pred] == -1)
+				{
+					continue;
+				}
+				if (new_idom == -1)
+				{
+					new_idom = pred;
+					continue;
+				}
+				while (pred != new_idom) // intersect
+				{
+					while (post[pred] < post[new_idom])
+					{
+						pred = idom[pred];
+					}
+					while (post[new_idom] < post[pred])
+					{
+						new_idom = idom[new_idom];
+					}
+				}
+			}
+			if (idom[node] != new_idom)
+			{
+				idom[node] = new_idom;
+				changed = 1;
+			}
+		}
+	} while (changed);
+
+	for (i = 0; i < n; i++)
+	{
+		retained[i] = snap->objects[i].bytes;
+	}
+	retained[root] = 0;
+	for (k = 0; k < count - 1; k++) // postorder puts a node before its dominators
+	{
+		int node = order[k];
+		retained[idom[node]] += retained[node];
+	}
+cleanup:
+	free(parents);
+	free(children);
+	free(first_parent);
+	free(first_child);
+	free(post);
+	free(order);
+	free(idom);
+	free(stack);
+	free(from_root);
+	return retained;
+}
+
+// entries hold object indices in path, replaced by offsets of the retention paths
+static int diff_paths(HeapDiff *diff, const HeapSnapshot *snap, const IdIndex *index)
+{
+	int *pred = retention_tree(snap, index);
+	int j;
+	if (pred == NULL)
+	{
+		return 0;
+	}
+	for (j = 0; j < diff->count; j++)
+	{
+		int obj = diff->entries[j].path;
+		diff->entries[j].path = pred[obj] == -1 ? -1 : diff_path(diff, snap, index, pred, obj);
+	}
+	free(pred);
+	return 1;
+}
+
+static int retained_cmp(const void *a, const void *b)
+{
+	const HeapDiffEntry *x = (const HeapDiffEntry *)a, *y = (const HeapDiffEntry *)b;
+	return x->retained > y->retained ? -1 : (x->retained < y->retained ? 1 : 0);
+}
+
+static int diff_entry_cmp(const void *a, const void *b)
+{
+	const HeapDiffEntry *x = (const HeapDiffEntry *)a, *y = (const HeapDiffEntry *)b;
+	int64_t gx = (int64_t)x->count_to - x->count_from, gy = (int64_t)y->count_to - y->count_from;
+	return gx > gy ? -1 : (gx < gy ? 1 : 0);
+}
+
+// objects in both snapshots whose entry count grew, largest growth first; NULL if out of memory
+LUA_API HeapDiff *xlua_snapshot_diff(const HeapSnapshot *from, const HeapSnapshot *to)
+{
+	HeapDiff *diff = (HeapDiff *)calloc(1, sizeof(HeapDiff));
+	IdIndex from_index, to_index;
+	uint64_t *retained = NULL;
+	uint32_t i;
+	int ok = 0;
+	memset(&from_index, 0, sizeof(IdIndex));
+	memset(&to_index, 0, sizeof(IdIndex));
+	if (diff == NULL || !id_index_build(&from_index, from) || !id_index_build(&to_index, to))
+	{
+		goto cleanup;
+	}
+	for (i = 0; i < to->header.object_count; i++)
+	{
+		const SnapshotObject *obj = &to->objects[i];
+		int old = id_index_get(&from_index, obj->id);
+		if (old >= 0 && from->objects[old].type == obj->type && from->objects[old].count < obj->count)
+		{
+			HeapDiffEntry *entry;
+			if (!grow((void **)&diff->entries, &diff->capacity, diff->count + 1, sizeof(HeapDiffEntry), 64))
+			{
+				goto cleanup;
+			}
+			entry = &diff->entries[diff->count++];
+			entry->id = obj->id;
+			entry->type = obj->type;
+			entry->bytes = obj->bytes;
+			entry->count_from = from->objects[old].count;
+			entry->count_to = obj->count;
+			entry->path = (int32_t)i; // object index until the paths are made
+			entry->reserved = 0;
+		}
+	}
+	if (diff->count > 0)
+	{
+		int j;
+		if ((retained = retained_sizes(to, &to_index)) == NULL)
+		{
+			goto cleanup;
+		}
+		for (j = 0; j < diff->count; j++)
+		{
+			diff->entries[j].retained = retained[diff->entries[j].path];
+		}
+		qsort(diff->entries, diff->count, sizeof(HeapDiffEntry), diff_entry_cmp);
+		if (!diff_paths(diff, to, &to_index))
+		{
+			goto cleanup;
+		}
+	}
+	ok = 1;
+cleanup:
+	free(retained);
+	id_index_free(&from_index);
+	id_index_free(&to_index);
+	if (!ok && diff != NULL)
+	{
+		free(diff->entries);
+		free(diff->strings);
+		free(diff);
+		diff = NULL;
+	}
+	return diff;
+}
+
+LUA_API const HeapDiffEntry *xlua_snapshotdiff_entries(HeapDiff *diff, int *count)
+{
+	*count = diff->count;
+	return diff->entries;
+}
+
+LUA_API const char *xlua_snapshotdiff_strings(HeapDiff *diff, int *size)
+{
+	*size = diff->string_size;
+	return diff->strings;
+}
+
+LUA_API void xlua_snapshotdiff_free(HeapDiff *diff)
+{
+	if (diff != NULL)
+	{
+		free(diff->entries);
+		free(diff->strings);
+		free(diff);
+	}
+}
+
+// the max_count heaviest retainers (the registry and the globals aside) of a snapshot; NULL if out of memory
+LUA_API HeapDiff *xlua_snapshot_retainers(const HeapSnapshot *snap, int max_count)
+{
+	HeapDiff *diff = (HeapDiff *)calloc(1, sizeof(HeapDiff));
+	IdIndex index;
+	uint64_t *retained = NULL;
+	uint32_t i;
+	int ok = 0;
+	memset(&index, 0, sizeof(IdIndex));
+	if (diff == NULL || !id_index_build(&index, snap) || (retained = retained_sizes(snap, &index)) == NULL
+		|| !grow((void **)&diff->entries, &diff->capacity, snap->header.object_count + 1, sizeof(HeapDiffEntry), 64))
+	{
+		goto cleanup;
+	}
+	for (i = 0; i < snap->header.object_count; i++)
+	{
+		const SnapshotObject *obj = &snap->objects[i];
+		HeapDiffEntry *entry;
+		if (obj->id == snap->header.registry || obj->id == snap->header.global)
+		{
+			continue;
+		}
+		entry = &diff->entries[diff->count++];
+		entry->id = obj->id;
+		entry->retained = retained[i];
+		entry->type = obj->type;
+		entry->bytes = obj->bytes;
+		entry->count_from = entry->count_to = obj->count;
+		entry->path = (int32_t)i;
+		entry->reserved = 0;
+	}
+	qsort(diff->entries, diff->count, sizeof(HeapDiffEntry), retained_cmp);
+	if (diff->count > max_count)
+	{
+		diff->count = max_count < 0 ? 0 : max_count;
+	}
+	ok = diff_paths(diff, snap, &index);
+cleanup:
+	free(retained);
+	id_index_free(&index);
+	if (!ok && diff != NULL)
+	{
+		xlua_snapshotdiff_free(diff);
+		diff = NULL;
+	}
+	return diff;
 }
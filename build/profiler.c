@@ -0,0 +1,537 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) 2024 - present handsomesnail
+ *  Licensed under the MIT License. See LICENSE in the project root for more information.
+ *--------------------------------------------------------------------------------------------*/
+
+#define LUA_LIB
+
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+** native sampling profiler
+**
+** A count hook (optionally gated by a wall clock interval) walks the Lua stack into a preallocated ring buffer of
+** symbol ids. When the ring is full, or when Lua asks for a report, the samples are folded into a fixed-capacity
+** stack table. Nothing is allocated and no Lua function is called while sampling. Each lua_State has its own Profiler,
+** kept in a registry userdata and released when the state is closed.
+*/
+
+#define PROFILER_MAX_DEPTH 64
+#define PROFILER_RING_SIZE 1024
+#define PROFILER_FUNC_SLOTS 16384  // function pointer -> symbol id cache, power of 2
+#define PROFILER_SYMBOL_SLOTS 8192  // symbol name -> symbol id, power of 2
+#define PROFILER_NAME_ARENA (256 * 1024)
+#define PROFILER_STACK_SLOTS 16384  // folded stacks, power of 2
+#define PROFILER_FRAME_POOL (256 * 1024)
+
+#define PROFILER_DEFAULT_PERIOD 1000
+#define PROFILER_OVERFLOW_SYMBOL 0  // symbol id shared by everything that did not fit
+
+// a collected function's address can be reused, so a hit is only trusted if the function identity matches too
+typedef struct {
+  const void *func;
+  const void *ident;  // source of a Lua function's prototype, lua_CFunction of a C function
+  int line;
+  uint32_t symbol;
+} ProfilerFunc;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t name;  // offset in name arena, 0 means empty slot
+  uint32_t source;
+} ProfilerSymbol;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t count;
+  uint32_t frames;  // offset in frame pool
+  uint32_t depth;
+} ProfilerStack;
+
+typedef struct {
+  uint32_t depth;
+  uint32_t frames[PROFILER_MAX_DEPTH];  // leaf first
+} ProfilerSample;
+
+typedef struct {
+  int running;
+  int period;
+  uint64_t interval_us;
+  uint64_t last_sample_us;
+
+  ProfilerSample *ring;
+  uint32_t ring_count;
+
+  ProfilerFunc *funcs;
+  uint32_t func_count;
+  ProfilerSymbol *symbols;
+  uint32_t symbol_count;
+  char *names;
+  uint32_t names_used;
+
+  ProfilerStack *stacks;
+  uint32_t stack_count;
+  uint32_t *frames;
+  uint32_t frames_used;
+
+  uint32_t samples;
+  uint32_t dropped;
+} Profiler;
+
+static int profiler_key = 0;  // registry key: Profiler userdata of this lua_State
+
+static uint64_t profiler_now_us() {
+#if defined(_WIN32) || defined(_WIN64)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (freq.QuadPart == 0) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t)(now.QuadPart * 1000000 / freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+static uint32_t profiler_hash_bytes(uint32_t h, const void *p, size_t len) {
+  const unsigned char *s = (const unsigned char *)p;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h = (h ^ s[i]) * 16777619u;
+  }
+  return h;
+}
+
+static uint32_t profiler_hash_ptr(const void *p) {
+  uintptr_t v = (uintptr_t)p;
+  v ^= v >> 17;
+  v *= 0xed5ad4bbu;
+  v ^= v >> 11;
+  return (uint32_t)v;
+}
+
+static void profiler_free(Profiler *p) {
+  free(p->ring);
+  free(p->funcs);
+  free(p->symbols);
+  free(p->names);
+  free(p->stacks);
+  free(p->frames);
+  memset(p, 0, sizeof(Profiler));
+}
+
+static uint32_t profiler_add_name(Profiler *p, const char *s, size_t len) {
+  uint32_t offset = p->names_used;
+  if (offset + len + 1 > PROFILER_NAME_ARENA) {
+    return 0;
+  }
+  memcpy(p->names + offset, s, len);
+  p->names[offset + len] = '\0';
+  p->names_used += (uint32_t)len + 1;
+  return offset;
+}
+
+static void profiler_reset(Profiler *p) {
+  memset(p->funcs, 0, sizeof(ProfilerFunc) * PROFILER_FUNC_SLOTS);
+  memset(p->symbols, 0, sizeof(ProfilerSymbol) * PROFILER_SYMBOL_SLOTS);
+  memset(p->stacks, 0, sizeof(ProfilerStack) * PROFILER_STACK_SLOTS);
+  p->ring_count = 0;
+  p->func_count = 0;
+  p->stack_count = 0;
+  p->frames_used = 0;
+  p->samples = 0;
+  p->dropped = 0;
+  // offset 0 is reserved so that an empty symbol slot can be told apart, slot 0 is the overflow symbol
+  p->names_used = 1;
+  p->symbols[PROFILER_OVERFLOW_SYMBOL].name = profiler_add_name(p, "[overflow]", 10);
+  p->symbols[PROFILER_OVERFLOW_SYMBOL].source = profiler_add_name(p, "[?]", 3);
+  p->symbol_count = 1;
+}
+
+static int profiler_alloc(Profiler *p) {
+  if (p->ring != NULL) {
+    return 1;
+  }
+  p->ring = (ProfilerSample *)malloc(sizeof(ProfilerSample) * PROFILER_RING_SIZE);
+  p->funcs = (ProfilerFunc *)malloc(sizeof(ProfilerFunc) * PROFILER_FUNC_SLOTS);
+  p->symbols = (ProfilerSymbol *)malloc(sizeof(ProfilerSymbol) * PROFILER_SYMBOL_SLOTS);
+  p->names = (char *)malloc(PROFILER_NAME_ARENA);
+  p->stacks = (ProfilerStack *)malloc(sizeof(ProfilerStack) * PROFILER_STACK_SLOTS);
+  p->frames = (uint32_t *)malloc(sizeof(uint32_t) * PROFILER_FRAME_POOL);
+  if (p->ring == NULL || p->funcs == NULL || p->symbols == NULL || p->names == NULL ||
+      p->stacks == NULL || p->frames == NULL) {
+    profiler_free(p);
+    return 0;
+  }
+  profiler_reset(p);
+  return 1;
+}
+
+// symbols are keyed by "name\0source", so different closures of one prototype share a symbol
+static uint32_t profiler_intern_symbol(Profiler *p, const char *name, const char *source, int line) {
+  char buf[LUA_IDSIZE + 192];
+  size_t name_len = strlen(name);
+  size_t len;
+  uint32_t hash, slot, mask = PROFILER_SYMBOL_SLOTS - 1;
+  ProfilerSymbol *sym;
+
+  if (name_len > 127) {
+    name_len = 127;
+  }
+  memcpy(buf, name, name_len);
+  buf[name_len] = '\0';
+  if (line > 0) {
+    len = name_len + 1 + snprintf(buf + name_len + 1, sizeof(buf) - name_len - 1, "%s:%d", source, line);
+  } else {
+    len = name_len + 1 + snprintf(buf + name_len + 1, sizeof(buf) - name_len - 1, "%s", source);
+  }
+  if (len >= sizeof(buf)) {
+    len = sizeof(buf) - 1;
+  }
+
+  hash = profiler_hash_bytes(2166136261u, buf, len);
+  slot = hash & mask;
+  // slot 0 belongs to the overflow symbol
+  if (slot == PROFILER_OVERFLOW_SYMBOL) {
+    slot = 1;
+  }
+  for (;;) {
+    sym = &p->symbols[slot];
+    if (sym->name == 0) {
+      break;
+    }
+    if (sym->hash == hash && memcmp(p->names + sym->name, buf, len) == 0 &&
+        p->names[sym->name + len] == '\0') {
+      return slot;
+    }
+    slot = (slot + 1) & mask;
+    if (slot == PROFILER_OVERFLOW_SYMBOL) {
+      slot = 1;
+    }
+  }
+
+  if (p->symbol_count >= PROFILER_SYMBOL_SLOTS * 3 / 4) {
+    return PROFILER_OVERFLOW_SYMBOL;
+  }
+  sym->name = profiler_add_name(p, buf, len);
+  if (sym->name == 0) {
+    return PROFILER_OVERFLOW_SYMBOL;
+  }
+  sym->source = sym->name + (uint32_t)name_len + 1;
+  sym->hash = hash;
+  p->symbol_count++;
+  return slot;
+}
+
+static uint32_t profiler_resolve(Profiler *p, lua_State *L, lua_Debug *ar) {
+  const char *name;
+  lua_getinfo(L, "nS", ar);
+  if (*(ar->what) == 'C') {
+    return profiler_intern_symbol(p, ar->name ? ar->name : "[anonymous]", "[C]", 0);
+  } else if (*(ar->what) == 'm') {
+    return profiler_intern_symbol(p, "[main chunk]", ar->short_src, 0);
+  }
+  name = ar->name ? ar->name : "[anonymous]";
+  return profiler_intern_symbol(p, name, ar->short_src, ar->linedefined > 0 ? ar->linedefined : 0);
+}
+
+// a function address may be reused once it is collected, the entry is refreshed when the identity no longer matches
+static uint32_t profiler_symbol_of(Profiler *p, lua_State *L, lua_Debug *ar) {
+  const void *func, *ident;
+  uint32_t slot, mask = PROFILER_FUNC_SLOTS - 1;
+  ProfilerFunc *entry;
+
+  lua_getinfo(L, "Sf", ar);
+  func = lua_topointer(L, -1);
+  ident = *(ar->what) == 'C' ? (const void *)lua_tocfunction(L, -1) : (const void *)ar->source;
+  lua_pop(L, 1);
+
+  slot = profiler_hash_ptr(func) & mask;
+  for (;;) {
+    entry = &p->funcs[slot];
+    if (entry->func == func) {
+      if (entry->ident != ident || entry->line != ar->linedefined) {
+        entry->ident = ident;
+        entry->line = ar->linedefined;
+        entry->symbol = profiler_resolve(p, L, ar);
+      }
+      return entry->symbol;
+    }
+    if (entry->func == NULL) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  if (p->func_count >= PROFILER_FUNC_SLOTS * 3 / 4) {
+    return profiler_resolve(p, L, ar);
+  }
+  entry->func = func;
+  entry->ident = ident;
+  entry->line = ar->linedefined;
+  entry->symbol = profiler_resolve(p, L, ar);
+  p->func_count++;
+  return entry->symbol;
+}
+
+static void profiler_fold(Profiler *p, const ProfilerSample *sample) {
+  uint32_t hash, slot, mask = PROFILER_STACK_SLOTS - 1;
+  ProfilerStack *stack;
+
+  hash = profiler_hash_bytes(2166136261u, sample->frames, sizeof(uint32_t) * sample->depth);
+  slot = hash & mask;
+  for (;;) {
+    stack = &p->stacks[slot];
+    if (stack->count == 0) {
+      break;
+    }
+    if (stack->hash == hash && stack->depth == sample->depth &&
+        memcmp(p->frames + stack->frames, sample->frames, sizeof(uint32_t) * sample->depth) == 0) {
+      stack->count++;
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  if (p->stack_count >= PROFILER_STACK_SLOTS * 3 / 4 ||
+      p->frames_used + sample->depth > PROFILER_FRAME_POOL) {
+    p->dropped++;
+    return;
+  }
+  stack->hash = hash;
+  stack->count = 1;
+  stack->depth = sample->depth;
+  stack->frames = p->frames_used;
+  memcpy(p->frames + stack->frames, sample->frames, sizeof(uint32_t) * sample->depth);
+  p->frames_used += sample->depth;
+  p->stack_count++;
+}
+
+static void profiler_drain(Profiler *p) {
+  uint32_t i;
+  for (i = 0; i < p->ring_count; i++) {
+    profiler_fold(p, &p->ring[i]);
+  }
+  p->ring_count = 0;
+}
+
+static int profiler_gc(lua_State *L) {
+  profiler_free((Profiler *)lua_touserdata(L, 1));
+  return 0;
+}
+
+// the Profiler of this lua_State (shared by its coroutines), NULL if there is none and create is 0
+static Profiler *profiler_get(lua_State *L, int create) {
+  Profiler *p;
+  lua_pushlightuserdata(L, &profiler_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  p = (Profiler *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (p != NULL || !create) {
+    return p;
+  }
+
+  lua_pushlightuserdata(L, &profiler_key);
+  p = (Profiler *)lua_newuserdata(L, sizeof(Profiler));
+  memset(p, 0, sizeof(Profiler));
+  lua_newtable(L);
+  lua_pushcfunction(L, profiler_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+  return p;
+}
+
+static void profiler_hook(lua_State *L, lua_Debug *ar) {
+  lua_Debug frame;
+  ProfilerSample *sample;
+  Profiler *p = profiler_get(L, 0);
+  int level;
+  (void)ar;
+
+  // coroutines created while running inherit the hook, detach them lazily once stopped
+  if (p == NULL || !p->running) {
+    lua_sethook(L, 0, 0, 0);
+    return;
+  }
+
+  if (p->interval_us > 0) {
+    uint64_t now = profiler_now_us();
+    if (now - p->last_sample_us < p->interval_us) {
+      return;
+    }
+    p->last_sample_us = now;
+  }
+
+  if (p->ring_count == PROFILER_RING_SIZE) {
+    profiler_drain(p);
+  }
+  sample = &p->ring[p->ring_count];
+  sample->depth = 0;
+  for (level = 0; sample->depth < PROFILER_MAX_DEPTH && lua_getstack(L, level, &frame); level++) {
+    sample->frames[sample->depth++] = profiler_symbol_of(p, L, &frame);
+  }
+  if (sample->depth > 0) {
+    p->ring_count++;
+    p->samples++;
+  }
+}
+
+// param --- [1]: count(instructions between hook ticks, optional), [2]: interval(microseconds, optional)
+static int profiler_start(lua_State *L) {
+  int period = (int)luaL_optinteger(L, 1, PROFILER_DEFAULT_PERIOD);
+  lua_Integer interval = luaL_optinteger(L, 2, 0);
+  Profiler *p;
+  if (period <= 0) {
+    return luaL_error(L, "profiler count must larger than 0");
+  }
+  p = profiler_get(L, 1);
+  if (!profiler_alloc(p)) {
+    return luaL_error(L, "profiler out of memory");
+  }
+  p->running = 1;
+  p->period = period;
+  p->interval_us = interval > 0 ? (uint64_t)interval : 0;
+  p->last_sample_us = 0;
+  lua_sethook(L, profiler_hook, LUA_MASKCOUNT, period);
+  return 0;
+}
+
+static int profiler_stop(lua_State *L) {
+  Profiler *p = profiler_get(L, 0);
+  if (lua_gethook(L) == profiler_hook) {
+    lua_sethook(L, 0, 0, 0);
+  }
+  if (p != NULL) {
+    p->running = 0;
+  }
+  return 0;
+}
+
+static int profiler_clear(lua_State *L) {
+  Profiler *p = profiler_get(L, 0);
+  profiler_stop(L);
+  if (p != NULL) {
+    profiler_free(p);
+  }
+  return 0;
+}
+
+// return --- [1]: {{name, source, self, total}, ...}, [2]: samples, [3]: dropped samples
+static int profiler_summary(lua_State *L) {
+  Profiler *p = profiler_get(L, 0);
+  uint32_t *self_count, *total_count, *seen;
+  uint32_t i, d, k, n = 0;
+
+  lua_newtable(L);
+  if (p == NULL || p->ring == NULL) {
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, 0);
+    return 3;
+  }
+  profiler_drain(p);
+
+  self_count = (uint32_t *)calloc(PROFILER_SYMBOL_SLOTS * 3, sizeof(uint32_t));
+  if (self_count == NULL) {
+    return luaL_error(L, "profiler out of memory");
+  }
+  total_count = self_count + PROFILER_SYMBOL_SLOTS;
+  seen = total_count + PROFILER_SYMBOL_SLOTS;  // last stack index + 1 that counted the symbol, for recursion
+
+  for (i = 0; i < PROFILER_STACK_SLOTS; i++) {
+    const ProfilerStack *stack = &p->stacks[i];
+    const uint32_t *frames = p->frames + stack->frames;
+    if (stack->count == 0) {
+      continue;
+    }
+    self_count[frames[0]] += stack->count;
+    for (d = 0; d < stack->depth; d++) {
+      if (seen[frames[d]] != i + 1) {
+        seen[frames[d]] = i + 1;
+        total_count[frames[d]] += stack->count;
+      }
+    }
+  }
+
+  for (k = 0; k < PROFILER_SYMBOL_SLOTS; k++) {
+    const ProfilerSymbol *sym = &p->symbols[k];
+    if (total_count[k] == 0) {
+      continue;
+    }
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, p->names + sym->name);
+    lua_setfield(L, -2, "name");
+    lua_pushstring(L, p->names + sym->source);
+    lua_setfield(L, -2, "source");
+    lua_pushinteger(L, self_count[k]);
+    lua_setfield(L, -2, "self");
+    lua_pushinteger(L, total_count[k]);
+    lua_setfield(L, -2, "total");
+    lua_rawseti(L, -2, ++n);
+  }
+  free(self_count);
+
+  lua_pushinteger(L, p->samples);
+  lua_pushinteger(L, p->dropped);
+  return 3;
+}
+
+// return --- [1]: folded stacks, one "root;...;leaf count" per line, ready for flamegraph.pl
+static int profiler_dump(lua_State *L) {
+  Profiler *p = profiler_get(L, 0);
+  luaL_Buffer b;
+  char count[16];
+  uint32_t i;
+  int d;
+
+  luaL_buffinit(L, &b);
+  if (p != NULL && p->ring != NULL) {
+    profiler_drain(p);
+    for (i = 0; i < PROFILER_STACK_SLOTS; i++) {
+      const ProfilerStack *stack = &p->stacks[i];
+      const uint32_t *frames = p->frames + stack->frames;
+      if (stack->count == 0) {
+        continue;
+      }
+      for (d = (int)stack->depth - 1; d >= 0; d--) {
+        const ProfilerSymbol *sym = &p->symbols[frames[d]];
+        luaL_addstring(&b, p->names + sym->name);
+        luaL_addstring(&b, " (");
+        luaL_addstring(&b, p->names + sym->source);
+        luaL_addstring(&b, d > 0 ? ");" : ") ");
+      }
+      snprintf(count, sizeof(count), "%u\n", stack->count);
+      luaL_addstring(&b, count);
+    }
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+static const luaL_Reg profilerlib[] = {{"start", profiler_start}, {"stop", profiler_stop},   {"clear", profiler_clear},
+                                       {"summary", profiler_summary}, {"dump", profiler_dump}, {NULL, NULL}};
+
+void luaopen_profiler(lua_State *L) {
+  lua_newtable(L);
+#if LUA_VERSION_NUM >= 502
+  luaL_setfuncs(L, profilerlib, 0);
+#else
+  luaL_register(L, NULL, profilerlib);
+#endif
+}
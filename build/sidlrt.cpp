@@ -13,7 +13,11 @@ extern "C" {
 
 #include <stdint.h>
 #include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "i64lib.h"
+#include "slab_alloc.h"
 
 #if USING_LUAJIT
 #include "lj_obj.h"
@@ -25,6 +29,13 @@ extern "C" {
 
 using namespace SidlRT;
 
+// 不超过这个长度的字符串在所有Lua版本里都是内部化的
+#if defined(LUAI_MAXSHORTLEN)
+#define SIDL_MAX_CACHED_FIELD_NAME LUAI_MAXSHORTLEN
+#else
+#define SIDL_MAX_CACHED_FIELD_NAME 40
+#endif
+
 static SidlInstanceType GetSidlInstanceTypeByFieldType(SidlFieldType sidl_field_type) {
   switch (sidl_field_type) {
     case SidlFieldType::OBJECT:
@@ -39,6 +50,7 @@ static SidlInstanceType GetSidlInstanceTypeByFieldType(SidlFieldType sidl_field_
 }
 
 EXPORT void *CALL luaL_testudata(lua_State *L, int ud, const char *tname);
+EXPORT uint32_t CALL xlua_objlen(lua_State *L, int idx);
 
 EXPORT int CALL xlua_issidlvalue(lua_State *L, int idx, SidlFieldType sidl_field_type);
 EXPORT SidlValue CALL xlua_tosidlvalue(lua_State *L, int idx, SidlFieldType sidl_field_type);
@@ -68,6 +80,197 @@ static int sidlmap_paris(lua_State *L);
 static int sidlinstance_gc(lua_State *L);
 static int sidlinstance_tostring(lua_State *L);
 
+struct SidlMetaCache;
+
+/// @brief Sidl实例的UserData，instance_id必须是第一个成员，其他地方(包括C#侧)都按uint64_t读取
+struct SidlInstanceUserData {
+  uint64_t instance_id;
+  SidlMetaCache *meta;  // SidlObject的字段类型缓存，首次访问字段时绑定
+  int slot;             // 在SidlStateCache弱表中的槽位
+};
+
+/// @brief 字段句柄，预先记录(类型名, 字段名)，字段类型在首次使用时解析并缓存
+struct SidlFieldHandle {
+  SidlFieldType field_type;
+  const char *meta_name;   // 指向句柄内存尾部
+  const char *field_name;  // 指向句柄内存尾部
+};
+
+static const char *field_handle_tname = "SidlFieldHandle";
+
+/// @brief 某个meta的字段类型缓存，以Lua短字符串(已内部化)的地址为key的开放寻址表
+/// @note 作为key的字符串都锚定在注册表里，地址在lua_State关闭前不会被复用
+struct SidlMetaCache {
+  std::string meta_name;
+  std::vector<const char *> names;
+  std::vector<SidlFieldType> types;
+  uint32_t count = 0;
+};
+
+/// @brief pairs(SidlMap)的native游标，记录上一次返回的key，下一次next调用凭key找回游标
+struct SidlMapCursor {
+  uint64_t map_instance_id = NULL_OBJECT_INSTANCE_ID;  // 为0表示空闲
+  uint64_t iter_instance_id = NULL_OBJECT_INSTANCE_ID;
+  int version = 0;
+  SidlValue last_key;
+  std::string last_key_str;  // STRING类型的key拷贝一份，不依赖运行时返回的指针
+  uint32_t stamp = 0;        // 最近使用时间，游标用完时淘汰最久未用的
+};
+
+#define SIDL_MAP_CURSORS 8
+
+/// @brief 每个lua_State一份的native状态，挂在注册表上，随lua_State关闭释放
+struct SidlStateCache {
+  // 字段类型缓存
+  std::unordered_map<std::string, SidlMetaCache *> metas;
+  int anchor_ref = LUA_NOREF;  // 锚定字段名字符串的table
+  // instance_id -> 弱表槽位，开放寻址(线性探测)，instance_id为0表示空位
+  std::vector<uint64_t> ids;
+  std::vector<int> slots;
+  uint32_t count = 0;
+  std::vector<int> free_slots;
+  int next_slot = 1;
+  int weak_ref = LUA_NOREF;  // 弱值table: 槽位 -> UserData
+  // SidlMap迭代
+  SidlMapCursor cursors[SIDL_MAP_CURSORS];
+  uint32_t cursor_stamp = 0;
+  int map_next_ref = LUA_NOREF;  // sidlmap_next，5.1下lua_pushcfunction每次都会创建闭包
+
+  ~SidlStateCache() {
+    for (auto &it : metas) {
+      delete it.second;
+    }
+    for (auto &cursor : cursors) {
+      if (cursor.map_instance_id != NULL_OBJECT_INSTANCE_ID) {
+        SidlAPI_ReleaseObject(cursor.iter_instance_id);
+      }
+    }
+  }
+};
+
+static int state_cache_key = 0;  // 注册表key: SidlStateCache UserData
+
+static int sidlstatecache_gc(lua_State *L) {
+  SidlStateCache **cache = (SidlStateCache **)lua_touserdata(L, 1);
+  delete *cache;
+  *cache = nullptr;
+  return 0;
+}
+
+/// @brief 取当前lua_State的SidlStateCache，create为false时不存在(或已随lua_State关闭释放)返回nullptr
+static SidlStateCache *sidl_get_state_cache(lua_State *L, bool create) {
+  lua_pushlightuserdata(L, &state_cache_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  SidlStateCache **cache = (SidlStateCache **)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (cache != nullptr || !create) {
+    return cache == nullptr ? nullptr : *cache;
+  }
+
+  lua_pushlightuserdata(L, &state_cache_key);
+  cache = (SidlStateCache **)lua_newuserdata(L, sizeof(SidlStateCache *));
+  *cache = new SidlStateCache();
+  lua_newtable(L);
+  lua_pushcfunction(L, sidlstatecache_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+
+  lua_newtable(L);
+  (*cache)->anchor_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_pushstring(L, "v");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+  (*cache)->weak_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_pushcfunction(L, sidlmap_next);
+  (*cache)->map_next_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  (*cache)->ids.resize(64, NULL_OBJECT_INSTANCE_ID);
+  (*cache)->slots.resize(64, 0);
+  return *cache;
+}
+
+/// @brief 同sidl_get_state_cache(L, true)，lua_State关闭过程中SidlStateCache已被释放时报错
+/// @note 比SidlStateCache更早设置__gc的对象，其finalizer在lua_close时晚于SidlStateCache执行
+static SidlStateCache *sidl_check_state_cache(lua_State *L) {
+  SidlStateCache *cache = sidl_get_state_cache(L, true);
+  if (cache == nullptr) {
+    luaL_error(L, "SidlRT state cache has been released, lua_State is closing");
+  }
+  return cache;
+}
+
+static uint32_t sidl_handle_pos(const SidlStateCache *cache, uint64_t instance_id) {
+  uint64_t h = instance_id * 0x9E3779B97F4A7C15ull;
+  return (uint32_t)(h >> 32) & (uint32_t)(cache->ids.size() - 1);
+}
+
+/// @brief 查找instance_id所在的槽位，不存在返回0
+static int sidl_handle_find(const SidlStateCache *cache, uint64_t instance_id) {
+  uint32_t mask = (uint32_t)(cache->ids.size() - 1);
+  for (uint32_t pos = sidl_handle_pos(cache, instance_id);; pos = (pos + 1) & mask) {
+    if (cache->ids[pos] == instance_id) {
+      return cache->slots[pos];
+    }
+    if (cache->ids[pos] == NULL_OBJECT_INSTANCE_ID) {
+      return 0;
+    }
+  }
+}
+
+static void sidl_handle_insert(SidlStateCache *cache, uint64_t instance_id, int slot) {
+  if ((cache->count + 1) * 2 > cache->ids.size()) {
+    std::vector<uint64_t> ids(cache->ids.size() * 2, NULL_OBJECT_INSTANCE_ID);
+    std::vector<int> slots(cache->ids.size() * 2, 0);
+    cache->ids.swap(ids);
+    cache->slots.swap(slots);
+    cache->count = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+      if (ids[i] != NULL_OBJECT_INSTANCE_ID) {
+        sidl_handle_insert(cache, ids[i], slots[i]);
+      }
+    }
+  }
+  uint32_t mask = (uint32_t)(cache->ids.size() - 1);
+  uint32_t pos = sidl_handle_pos(cache, instance_id);
+  while (cache->ids[pos] != NULL_OBJECT_INSTANCE_ID && cache->ids[pos] != instance_id) {
+    pos = (pos + 1) & mask;
+  }
+  if (cache->ids[pos] == NULL_OBJECT_INSTANCE_ID) {
+    cache->count++;
+  }
+  cache->ids[pos] = instance_id;
+  cache->slots[pos] = slot;
+}
+
+/// @brief 仅当instance_id仍映射到slot时删除，删除后把后续同簇的元素前移，不留墓碑
+static void sidl_handle_remove(SidlStateCache *cache, uint64_t instance_id, int slot) {
+  uint32_t mask = (uint32_t)(cache->ids.size() - 1);
+  uint32_t pos = sidl_handle_pos(cache, instance_id);
+  while (cache->ids[pos] != instance_id) {
+    if (cache->ids[pos] == NULL_OBJECT_INSTANCE_ID) {
+      return;
+    }
+    pos = (pos + 1) & mask;
+  }
+  if (cache->slots[pos] != slot) {
+    return;
+  }
+  cache->ids[pos] = NULL_OBJECT_INSTANCE_ID;
+  cache->count--;
+  for (uint32_t next = (pos + 1) & mask; cache->ids[next] != NULL_OBJECT_INSTANCE_ID; next = (next + 1) & mask) {
+    uint32_t home = sidl_handle_pos(cache, cache->ids[next]);
+    // home不在(pos, next]之间，说明next可以前移到pos
+    if ((next > pos && (home <= pos || home > next)) || (next < pos && (home <= pos && home > next))) {
+      cache->ids[pos] = cache->ids[next];
+      cache->slots[pos] = cache->slots[next];
+      cache->ids[next] = NULL_OBJECT_INSTANCE_ID;
+      pos = next;
+    }
+  }
+}
+
 static const char *tname_arr[5] = {"Unknown", "SidlObject", "SidlArray", "SidlMap", "SidlIter"};
 static const lua_CFunction index_funcs[5] = {nullptr, sidlobj_index, sidlarray_index, sidlmap_index, nullptr};
 static const lua_CFunction newindex_funcs[5] = {nullptr, sidlobj_newindex, sidlarray_newindex, sidlmap_newindex,
@@ -94,9 +297,11 @@ EXPORT void CALL xlua_pushsidlvalue(lua_State *L, SidlFieldType sidl_field_type,
 
 EXPORT int CALL xlua_issidlvalue(lua_State *L, int idx, SidlFieldType sidl_field_type) {
   if (sidl_field_type == SidlFieldType::INT || sidl_field_type == SidlFieldType::ENUM ||
-      sidl_field_type == SidlFieldType::LONG || sidl_field_type == SidlFieldType::FLOAT ||
-      sidl_field_type == SidlFieldType::DOUBLE) {
+      sidl_field_type == SidlFieldType::FLOAT || sidl_field_type == SidlFieldType::DOUBLE) {
     return lua_isnumber(L, idx);
+  } else if (sidl_field_type == SidlFieldType::LONG) {
+    // lua5.1/luajit下LONG是interned的int64 UserData(相同的值是同一个对象)，next返回的key可以直接传回来
+    return lua_isnumber(L, idx) || lua_isint64(L, idx) || lua_isuint64(L, idx);
   } else if (sidl_field_type == SidlFieldType::BOOL) {
     return lua_isboolean(L, idx);
   } else if (sidl_field_type == SidlFieldType::STRING) {
@@ -170,18 +375,40 @@ EXPORT void CALL xlua_pushsidlobj(lua_State *L, uint64_t instance_id) {
   }
 
   int top = lua_gettop(L);
-  lua_getglobal(L, "global_sidlobj_cache");  // R(top+1): global_sidlobj_cache
-  lua_pushuint64(L, instance_id);
-  lua_gettable(L, top + 1);  // R(top+2): UserData
+  SidlStateCache *cache = sidl_get_state_cache(L, true);
+  // R(top+1): 弱表，lua_State关闭过程中SidlStateCache已被释放时为nil，此时创建不进弱表的UserData(槽位0)
+  if (cache == nullptr) {
+    lua_pushnil(L);
+  } else {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, cache->weak_ref);
+  }
+  int slot = cache == nullptr ? 0 : sidl_handle_find(cache, instance_id);
+  if (slot != 0) {
+    lua_rawgeti(L, top + 1, slot);  // R(top+2): UserData
+  } else {
+    lua_pushnil(L);
+  }
 
   if (lua_type(L, -1) == LUA_TNIL) {
-    // 没有缓存，则创建新的UserData并放入global_sidlobj_cache
+    // 没有缓存(或已被回收、等待__gc)，则创建新的UserData，占用新槽位放入弱表
     lua_pop(L, 1);
-    uint64_t *pointer = (uint64_t *)lua_newuserdata(L, sizeof(uint64_t));
-    *pointer = instance_id;  // UserData只包含一个64位InstanceId
-    lua_pushuint64(L, instance_id);
-    lua_pushvalue(L, top + 2);
-    lua_settable(L, top + 1);
+    SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_newuserdata(L, sizeof(SidlInstanceUserData));
+    ud->instance_id = instance_id;
+    xlua_memstats_udata(L, ud, MEM_SIDL);
+    ud->meta = nullptr;
+    if (cache == nullptr) {
+      ud->slot = 0;
+    } else {
+      if (cache->free_slots.empty()) {
+        ud->slot = cache->next_slot++;
+      } else {
+        ud->slot = cache->free_slots.back();
+        cache->free_slots.pop_back();
+      }
+      lua_pushvalue(L, top + 2);
+      lua_rawseti(L, top + 1, ud->slot);
+      sidl_handle_insert(cache, instance_id, ud->slot);
+    }
 
     // 设置元表
     SidlInstanceType instanceType = SidlAPI_GetSidlInstanceType(instance_id);
@@ -233,37 +460,175 @@ EXPORT void CALL xlua_pushsidlobj(lua_State *L, uint64_t instance_id) {
   lua_settop(L, top + 1);
 }
 
-static int sidlobj_index(lua_State *L) {
-  uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
-  if (!lua_isstring(L, 2)) {
-    return luaL_error(L, "Field name doesn't match string type");
+static uint64_t field_cache_hits = 0;
+static uint64_t field_cache_misses = 0;
+
+EXPORT void CALL xlua_sidl_field_cache_stats(uint64_t *hits, uint64_t *misses, int reset) {
+  *hits = field_cache_hits;
+  *misses = field_cache_misses;
+  if (reset) {
+    field_cache_hits = 0;
+    field_cache_misses = 0;
+  }
+}
+
+/// @brief 取实例对应的字段类型缓存，首次调用时按meta名称绑定到UserData上，取不到meta名称时返回nullptr
+static SidlMetaCache *sidlobj_meta_cache(lua_State *L, SidlInstanceUserData *ud) {
+  // invalidate后instance_id被置空，但ud->meta仍指向原来的缓存，不能再用
+  if (ud->instance_id == NULL_OBJECT_INSTANCE_ID) {
+    return nullptr;
+  }
+  if (ud->meta == nullptr) {
+    const char *meta_cstr = SidlAPI_GetInstanceMetaName(ud->instance_id).stringValue;
+    if (meta_cstr == nullptr) {
+      return nullptr;
+    }
+    SidlStateCache *cache = sidl_check_state_cache(L);
+    std::string meta_name = meta_cstr;
+    SidlMetaCache *&meta = cache->metas[meta_name];
+    if (meta == nullptr) {
+      meta = new SidlMetaCache();
+      meta->meta_name = meta_name;
+      meta->names.resize(16, nullptr);
+      meta->types.resize(16, SidlFieldType::UNKNOWN);
+    }
+    ud->meta = meta;
   }
-  const char *field_name = lua_tostring(L, 2);  // R(2): FieldName
-  SidlFieldType sidl_field_type = SidlAPI_GetFieldType(instance_id, field_name);
-  if (sidl_field_type == SidlFieldType::UNKNOWN) {
-    return luaL_error(L, "The field \"%s\" doesn't exist", field_name);
+  return ud->meta;
+}
+
+static uint32_t sidl_meta_slot(const SidlMetaCache *meta, const char *name) {
+  uint32_t h = (uint32_t)((uintptr_t)name >> 3) * 2654435761u;
+  return h & (uint32_t)(meta->names.size() - 1);
+}
+
+static SidlFieldType sidl_meta_find(const SidlMetaCache *meta, const char *name) {
+  uint32_t mask = (uint32_t)(meta->names.size() - 1);
+  for (uint32_t slot = sidl_meta_slot(meta, name);; slot = (slot + 1) & mask) {
+    if (meta->names[slot] == name) {
+      return meta->types[slot];
+    }
+    if (meta->names[slot] == nullptr) {
+      return SidlFieldType::UNKNOWN;
+    }
+  }
+}
+
+/// @brief 记录字段类型，name_idx处的字符串被锚定
+static void sidl_meta_insert(lua_State *L, SidlMetaCache *meta, int name_idx, SidlFieldType sidl_field_type) {
+  if ((meta->count + 1) * 2 > meta->names.size()) {
+    std::vector<const char *> names(meta->names.size() * 2, nullptr);
+    std::vector<SidlFieldType> types(meta->names.size() * 2, SidlFieldType::UNKNOWN);
+    meta->names.swap(names);
+    meta->types.swap(types);
+    uint32_t mask = (uint32_t)(meta->names.size() - 1);
+    for (size_t i = 0; i < names.size(); i++) {
+      if (names[i] != nullptr) {
+        uint32_t slot = sidl_meta_slot(meta, names[i]);
+        while (meta->names[slot] != nullptr) {
+          slot = (slot + 1) & mask;
+        }
+        meta->names[slot] = names[i];
+        meta->types[slot] = types[i];
+      }
+    }
+  }
+  const char *name = lua_tostring(L, name_idx);
+  uint32_t mask = (uint32_t)(meta->names.size() - 1);
+  uint32_t slot = sidl_meta_slot(meta, name);
+  while (meta->names[slot] != nullptr) {
+    slot = (slot + 1) & mask;
+  }
+  meta->names[slot] = name;
+  meta->types[slot] = sidl_field_type;
+  meta->count++;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, sidl_check_state_cache(L)->anchor_ref);
+  lua_pushvalue(L, name_idx);
+  lua_pushboolean(L, 1);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+/// @brief 解析key_idx处的字段名或字段句柄，返回字段名并通过sidl_field_type返回字段类型，字段不存在时报错
+static const char *sidlobj_check_field(lua_State *L, SidlInstanceUserData *ud, int key_idx,
+                                       SidlFieldType *sidl_field_type) {
+  if (key_idx < 0) {
+    key_idx = lua_gettop(L) + key_idx + 1;
+  }
+  if (lua_type(L, key_idx) == LUA_TUSERDATA) {
+    SidlFieldHandle *handle = (SidlFieldHandle *)luaL_testudata(L, key_idx, field_handle_tname);
+    if (handle != nullptr) {
+      // 空实例或取不到meta名称时没有字段可查，与未缓存时的行为一致报字段不存在
+      SidlMetaCache *meta = sidlobj_meta_cache(L, ud);
+      if (meta == nullptr) {
+        luaL_error(L, "The field \"%s\" doesn't exist", handle->field_name);
+        return nullptr;
+      }
+      if (meta->meta_name != handle->meta_name) {
+        luaL_error(L, "The field handle \"%s.%s\" doesn't match type \"%s\"", handle->meta_name, handle->field_name,
+                   meta->meta_name.c_str());
+        return nullptr;
+      }
+      if (handle->field_type == SidlFieldType::UNKNOWN) {
+        handle->field_type = SidlAPI_GetFieldType(ud->instance_id, handle->field_name);
+        if (handle->field_type == SidlFieldType::UNKNOWN) {
+          luaL_error(L, "The field \"%s\" doesn't exist", handle->field_name);
+          return nullptr;
+        }
+      }
+      *sidl_field_type = handle->field_type;
+      return handle->field_name;
+    }
+  }
+
+  if (!lua_isstring(L, key_idx)) {
+    luaL_error(L, "Field name doesn't match string type");
+    return nullptr;
+  }
+  size_t len;
+  const char *field_name = lua_tolstring(L, key_idx, &len);
+  // 长字符串没有内部化，相同内容的地址不同，不进缓存；空实例取不到缓存，走SidlAPI_GetFieldType报字段不存在
+  bool cacheable = lua_type(L, key_idx) == LUA_TSTRING && len <= SIDL_MAX_CACHED_FIELD_NAME;
+  SidlMetaCache *meta = cacheable ? sidlobj_meta_cache(L, ud) : nullptr;
+  if (meta != nullptr) {
+    *sidl_field_type = sidl_meta_find(meta, field_name);
+    if (*sidl_field_type != SidlFieldType::UNKNOWN) {
+      field_cache_hits++;
+      return field_name;
+    }
+    field_cache_misses++;
   }
-  SidlValue value = SidlAPI_GetFieldValue(instance_id, field_name);
+  *sidl_field_type = SidlAPI_GetFieldType(ud->instance_id, field_name);
+  if (*sidl_field_type == SidlFieldType::UNKNOWN) {
+    luaL_error(L, "The field \"%s\" doesn't exist", field_name);
+    return nullptr;
+  }
+  if (meta != nullptr) {
+    sidl_meta_insert(L, meta, key_idx, *sidl_field_type);
+  }
+  return field_name;
+}
+
+static int sidlobj_index(lua_State *L) {
+  SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_touserdata(L, 1);  // R(1): UserData
+  SidlFieldType sidl_field_type;
+  const char *field_name = sidlobj_check_field(L, ud, 2, &sidl_field_type);  // R(2): FieldName
+  SidlValue value = SidlAPI_GetFieldValue(ud->instance_id, field_name);
   xlua_pushsidlvalue(L, sidl_field_type, value);  // Return(1): FieldValue
   return 1;
 }
 
 static int sidlobj_newindex(lua_State *L) {
-  uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
-  if (!lua_isstring(L, 2)) {
-    return luaL_error(L, "Field name doesn't match string type");
-  }
-  const char *field_name = lua_tostring(L, 2);  // R(2): FieldName
-  SidlFieldType sidl_field_type = SidlAPI_GetFieldType(instance_id, field_name);
-  if (sidl_field_type == SidlFieldType::UNKNOWN) {
-    return luaL_error(L, "The field \"%s\" doesn't exist", field_name);
-  }
-  int value_idx = 3;  // R(3): FieldValue
+  SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_touserdata(L, 1);  // R(1): UserData
+  SidlFieldType sidl_field_type;
+  const char *field_name = sidlobj_check_field(L, ud, 2, &sidl_field_type);  // R(2): FieldName
+  int value_idx = 3;                                                          // R(3): FieldValue
   if (!xlua_issidlvalue(L, value_idx, sidl_field_type)) {
     return luaL_error(L, "The field \"%s\" value doesn't match type", field_name);
   }
   SidlValue value = xlua_tosidlvalue(L, value_idx, sidl_field_type);
-  SidlAPI_SetFieldValue(instance_id, field_name, value);
+  SidlAPI_SetFieldValue(ud->instance_id, field_name, value);
   return 0;
 }
 
@@ -389,49 +754,153 @@ static int sidlmap_length(lua_State *L) {
   return 1;
 }
 
+static bool sidl_key_equal(SidlFieldType key_type, const SidlMapCursor &cursor, SidlValue key) {
+  switch (key_type) {
+    case SidlFieldType::INT:
+    case SidlFieldType::ENUM:
+      return cursor.last_key.intValue == key.intValue;
+    case SidlFieldType::LONG:
+      return cursor.last_key.longValue == key.longValue;
+    case SidlFieldType::FLOAT:
+      return cursor.last_key.floatValue == key.floatValue;
+    case SidlFieldType::DOUBLE:
+      return cursor.last_key.doubleValue == key.doubleValue;
+    case SidlFieldType::BOOL:
+      return cursor.last_key.booleanValue == key.booleanValue;
+    case SidlFieldType::STRING:
+      return key.stringValue != nullptr && cursor.last_key_str == key.stringValue;
+    default:
+      return cursor.last_key.objectInstanceId == key.objectInstanceId;
+  }
+}
+
+static void sidl_free_cursor(SidlMapCursor *cursor) {
+  SidlAPI_ReleaseObject(cursor->iter_instance_id);
+  cursor->map_instance_id = NULL_OBJECT_INSTANCE_ID;
+  cursor->iter_instance_id = NULL_OBJECT_INSTANCE_ID;
+}
+
+/// @brief 取一个空闲游标并创建迭代器，没有空闲时淘汰最久未用的(被中途break的循环留下的)
+static SidlMapCursor *sidl_new_cursor(SidlStateCache *cache, uint64_t instance_id) {
+  SidlMapCursor *cursor = &cache->cursors[0];
+  for (auto &it : cache->cursors) {
+    if (it.map_instance_id == NULL_OBJECT_INSTANCE_ID) {
+      cursor = &it;
+      break;
+    }
+    if (it.stamp < cursor->stamp) {
+      cursor = &it;
+    }
+  }
+  if (cursor->map_instance_id != NULL_OBJECT_INSTANCE_ID) {
+    sidl_free_cursor(cursor);
+  }
+  cursor->map_instance_id = instance_id;
+  cursor->iter_instance_id = SidlAPI_GetMapIter(instance_id);
+  SidlAPI_RetainObject(cursor->iter_instance_id);
+  cursor->version = SidlAPI_GetInstanceVersion(instance_id);
+  return cursor;
+}
+
+/// @brief 无状态的next(map, key)，不创建任何GC对象
+/// @note 游标被淘汰后(同时进行的循环超过SIDL_MAP_CURSORS个)，重新创建迭代器并跳到key之后，结果不变只是变慢
+/// @note 和SidlArray一样，迭代过程中map被修改时报错
 static int sidlmap_next(lua_State *L) {
-  uint64_t iter_instance_id = *(uint64_t *)lua_touserdata(L, lua_upvalueindex(1));  // UpValue[1]: Iter UserData
-  int version = lua_tointeger(L, lua_upvalueindex(2));                              // UpValue[2]: Version
-  uint64_t instance_id = *(uint64_t *)lua_touserdata(L, lua_upvalueindex(3));       // UpValue[3]: UserData
-  // 迭代过程中不允许修改
-  if (version != SidlAPI_GetInstanceVersion(instance_id)) {
-    return luaL_error(L, "SidlMap has been modified during iteration");
+  uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
+  SidlStateCache *cache = sidl_check_state_cache(L);
+  SidlFieldType key_type = SidlAPI_GetMapKeyMetaType(instance_id);
+  SidlMapCursor *cursor = nullptr;
+  if (lua_isnil(L, 2)) {  // R(2): 上一次的Key，nil表示开始迭代
+    // 被break的循环留下的游标在map修改后已过期，开始新的迭代时释放，避免之后按key误匹配到它们
+    int version = SidlAPI_GetInstanceVersion(instance_id);
+    for (auto &it : cache->cursors) {
+      if (it.map_instance_id == instance_id && it.version != version) {
+        sidl_free_cursor(&it);
+      }
+    }
+    cursor = sidl_new_cursor(cache, instance_id);
+  } else {
+    if (!xlua_issidlvalue(L, 2, key_type)) {
+      return luaL_error(L, "SidlMap key value doesn't match type");
+    }
+    SidlValue key = xlua_tosidlvalue(L, 2, key_type);
+    for (auto &it : cache->cursors) {
+      if (it.map_instance_id == instance_id && sidl_key_equal(key_type, it, key)) {
+        cursor = &it;
+        break;
+      }
+    }
+    if (cursor != nullptr) {
+      if (cursor->version != SidlAPI_GetInstanceVersion(instance_id)) {
+        sidl_free_cursor(cursor);
+        return luaL_error(L, "SidlMap has been modified during iteration");
+      }
+    } else {
+      cursor = sidl_new_cursor(cache, instance_id);
+      for (; !SidlAPI_IsMapIterEnd(cursor->iter_instance_id); SidlAPI_MoveMapIterNext(cursor->iter_instance_id)) {
+        cursor->last_key = SidlAPI_GetMapIterKey(cursor->iter_instance_id);
+        if (key_type == SidlFieldType::STRING) {
+          cursor->last_key_str = cursor->last_key.stringValue;
+        }
+        if (sidl_key_equal(key_type, *cursor, key)) {
+          SidlAPI_MoveMapIterNext(cursor->iter_instance_id);
+          break;
+        }
+      }
+    }
   }
+  cursor->stamp = ++cache->cursor_stamp;
   // 判断迭代结束
-  if (SidlAPI_IsMapIterEnd(iter_instance_id)) {
+  if (SidlAPI_IsMapIterEnd(cursor->iter_instance_id)) {
+    sidl_free_cursor(cursor);
     return 0;
   }
   // 压入当前迭代的键和值
-  SidlFieldType key_type = SidlAPI_GetMapKeyMetaType(instance_id);
-  SidlValue key = SidlAPI_GetMapIterKey(iter_instance_id);
-  xlua_pushsidlvalue(L, key_type, key);  // Return(1): Key
+  cursor->last_key = SidlAPI_GetMapIterKey(cursor->iter_instance_id);
+  if (key_type == SidlFieldType::STRING) {
+    cursor->last_key_str = cursor->last_key.stringValue;
+  }
+  xlua_pushsidlvalue(L, key_type, cursor->last_key);  // Return(1): Key
   SidlFieldType value_type = SidlAPI_GetMapValueMetaType(instance_id);
-  SidlValue value = SidlAPI_GetMapIterValue(iter_instance_id);
+  SidlValue value = SidlAPI_GetMapIterValue(cursor->iter_instance_id);
   xlua_pushsidlvalue(L, value_type, value);  // Return(2): Value
-  // 更新迭代器状态Iter
-  SidlAPI_MoveMapIterNext(iter_instance_id);
+  // 游标移到下一个
+  SidlAPI_MoveMapIterNext(cursor->iter_instance_id);
 
   return 2;
 }
 
 static int sidlmap_paris(lua_State *L) {
-  uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
-  uint64_t iter_instance_id = SidlAPI_GetMapIter(instance_id);
-  xlua_pushsidlobj(L, iter_instance_id);  // push UpValue[1]: 迭代器Iter UserData
-  int version = SidlAPI_GetInstanceVersion(instance_id);
-  lua_pushinteger(L, version);           // push UpValue[2]: 容器version
-  lua_pushvalue(L, 1);                   // push UpValue[3]: UserData自身
-  lua_pushcclosure(L, sidlmap_next, 3);  // Return(1): 将迭代器函数绑定到迭代器状态
-  lua_pushvalue(L, 1);                   // Return(2): UserData自身
-  lua_pushnil(L);                        // Return(3): 初始键nil
+  SidlStateCache *cache = sidl_check_state_cache(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, cache->map_next_ref);  // Return(1): 无状态的迭代器函数
+  lua_pushvalue(L, 1);                                      // Return(2): UserData自身
+  lua_pushnil(L);                                           // Return(3): 初始键nil
   return 3;
 }
 
 static int sidlinstance_gc(lua_State *L) {
-  uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
-  // 引用计数-1
+  SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_touserdata(L, 1);  // R(1): UserData
+  uint64_t instance_id = ud->instance_id;
+  // 从弱引用表中移除，lua_State关闭时SidlStateCache可能先被释放
+  SidlStateCache *cache = sidl_get_state_cache(L, false);
+  if (cache != nullptr && ud->slot != 0) {
+    if (instance_id != NULL_OBJECT_INSTANCE_ID) {
+      sidl_handle_remove(cache, instance_id, ud->slot);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, cache->weak_ref);
+    lua_rawgeti(L, -1, ud->slot);
+    if (lua_rawequal(L, -1, 1)) {
+      lua_pushnil(L);
+      lua_rawseti(L, -3, ud->slot);
+    }
+    lua_pop(L, 2);
+    cache->free_slots.push_back(ud->slot);
+  }
+  // 引用计数-1，之后被复活的UserData(比如lua_close时被更晚执行的finalizer访问)按无效对象处理，ud->meta可能已随
+  // SidlStateCache释放
   if (instance_id != NULL_OBJECT_INSTANCE_ID) {
     SidlAPI_ReleaseObject(instance_id);
+    ud->instance_id = NULL_OBJECT_INSTANCE_ID;
   }
   return 0;
 }
@@ -486,7 +955,13 @@ static int sidlrt_new_obj(lua_State *L) {
 /// @brief 设为无效(instance_id设为0)
 /// @example sidlrt.invalidate(obj)
 static int sidlrt_invalidate(lua_State *L) {
-  *(uint64_t *)lua_touserdata(L, 1) = NULL_OBJECT_INSTANCE_ID;  // R(1): UserData
+  SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_touserdata(L, 1);  // R(1): UserData
+  // 之后再push同一个instance_id会得到新的UserData
+  SidlStateCache *cache = sidl_get_state_cache(L, false);
+  if (cache != nullptr && ud->instance_id != NULL_OBJECT_INSTANCE_ID) {
+    sidl_handle_remove(cache, ud->instance_id, ud->slot);
+  }
+  ud->instance_id = NULL_OBJECT_INSTANCE_ID;
   return 0;
 }
 
@@ -594,6 +1069,192 @@ static int sidlrt_remove_map_key(lua_State *L) {
   return 1;
 }
 
+/// @brief SidlArray[from, to)或整个SidlMap一次性转成Lua table，元素类型只解析一次
+/// @note SidlArray转成从1开始的序列，from/to是SidlArray的下标(从0开始)，默认整个数组
+/// @example local list = sidlrt.totable(array)
+/// @example local part = sidlrt.totable(array, 10, 20)
+/// @example local dict = sidlrt.totable(map)
+static int sidlrt_to_table(lua_State *L) {
+  if (xlua_checksidlobj(L, 1, SidlInstanceType::ARRAY)) {
+    uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
+    int count = SidlAPI_GetArrayCount(instance_id);
+    int from = (int)luaL_optinteger(L, 2, 0);    // R(2): From
+    int to = (int)luaL_optinteger(L, 3, count);  // R(3): To
+    if (from < 0 || to > count || from > to) {
+      return luaL_error(L, "SidlArray index ArgumentOutOfRangeException");
+    }
+    SidlFieldType sidl_field_type = SidlAPI_GetArrayValueMetaType(instance_id);
+    lua_createtable(L, to - from, 0);  // Return(1): Table
+    for (int i = from; i < to; i++) {
+      xlua_pushsidlvalue(L, sidl_field_type, SidlAPI_GetArrayItemValue(instance_id, i));
+      lua_rawseti(L, -2, i - from + 1);
+    }
+    return 1;
+  } else if (xlua_checksidlobj(L, 1, SidlInstanceType::MAP)) {
+    uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
+    SidlFieldType key_type = SidlAPI_GetMapKeyMetaType(instance_id);
+    SidlFieldType value_type = SidlAPI_GetMapValueMetaType(instance_id);
+    lua_createtable(L, 0, SidlAPI_GetMapCount(instance_id));  // Return(1): Table
+    // 迭代器不push到Lua，用完即释放
+    uint64_t iter_instance_id = SidlAPI_GetMapIter(instance_id);
+    SidlAPI_RetainObject(iter_instance_id);
+    for (; !SidlAPI_IsMapIterEnd(iter_instance_id); SidlAPI_MoveMapIterNext(iter_instance_id)) {
+      xlua_pushsidlvalue(L, key_type, SidlAPI_GetMapIterKey(iter_instance_id));
+      xlua_pushsidlvalue(L, value_type, SidlAPI_GetMapIterValue(iter_instance_id));
+      lua_rawset(L, -3);
+    }
+    SidlAPI_ReleaseObject(iter_instance_id);
+    return 1;
+  }
+  return luaL_error(L, "Sidl instance type doesn't match");
+}
+
+/// @brief 用Lua table整体替换SidlArray或SidlMap的内容，先校验全部元素类型，校验通过才写入
+/// @note SidlArray按tbl[1..#tbl]的顺序写入，数组大小调整为#tbl
+/// @example sidlrt.fromtable(array, {1, 2, 3})
+/// @example sidlrt.fromtable(map, {a = 1, b = 2})
+static int sidlrt_from_table(lua_State *L) {
+  luaL_checktype(L, 2, LUA_TTABLE);  // R(2): Table
+  lua_settop(L, 2);
+  if (xlua_checksidlobj(L, 1, SidlInstanceType::ARRAY)) {
+    uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
+    SidlFieldType sidl_field_type = SidlAPI_GetArrayValueMetaType(instance_id);
+    int count = xlua_objlen(L, 2);
+    for (int i = 1; i <= count; i++) {
+      lua_rawgeti(L, 2, i);
+      if (!xlua_issidlvalue(L, -1, sidl_field_type)) {
+        return luaL_error(L, "SidlArray item value doesn't match type");
+      }
+      lua_pop(L, 1);
+    }
+    SidlAPI_ResizeArray(instance_id, count);
+    for (int i = 1; i <= count; i++) {
+      lua_rawgeti(L, 2, i);
+      SidlAPI_SetArrayItemValue(instance_id, i - 1, xlua_tosidlvalue(L, -1, sidl_field_type));
+      lua_pop(L, 1);
+    }
+    return 0;
+  } else if (xlua_checksidlobj(L, 1, SidlInstanceType::MAP)) {
+    uint64_t instance_id = *(uint64_t *)lua_touserdata(L, 1);  // R(1): UserData
+    SidlFieldType key_type = SidlAPI_GetMapKeyMetaType(instance_id);
+    SidlFieldType value_type = SidlAPI_GetMapValueMetaType(instance_id);
+    lua_pushnil(L);
+    while (lua_next(L, 2) != 0) {
+      if (!xlua_issidlvalue(L, -2, key_type)) {
+        return luaL_error(L, "SidlMap key value doesn't match type");
+      }
+      if (!xlua_issidlvalue(L, -1, value_type)) {
+        return luaL_error(L, "SidlMap value value doesn't match type");
+      }
+      lua_pop(L, 1);
+    }
+    SidlAPI_ClearMap(instance_id);
+    lua_pushnil(L);
+    while (lua_next(L, 2) != 0) {
+      // 复制一份key再转换，避免lua_tostring把数字key原地转成字符串打乱lua_next
+      lua_pushvalue(L, -2);
+      SidlValue key = xlua_tosidlvalue(L, -1, key_type);
+      SidlValue value = xlua_tosidlvalue(L, -2, value_type);
+      SidlAPI_SetMapItemValue(instance_id, key, value);
+      lua_pop(L, 2);
+    }
+    return 0;
+  }
+  return luaL_error(L, "Sidl instance type doesn't match");
+}
+
+/// @brief 批量读取SidlObject字段，字段可以是字段名或字段句柄，按顺序返回各字段的值
+/// @example local count, name = sidlrt.getfields(obj, {"count", "name"})
+static int sidlrt_get_fields(lua_State *L) {
+  if (!xlua_checksidlobj(L, 1, SidlInstanceType::OBJECT)) {
+    return luaL_error(L, "SidlObject type doesn't match");
+  }
+  luaL_checktype(L, 2, LUA_TTABLE);
+  SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_touserdata(L, 1);  // R(1): UserData
+  int count = xlua_objlen(L, 2);                                             // R(2): Fields
+  luaL_checkstack(L, count + 1, "too many fields");
+  for (int i = 1; i <= count; i++) {
+    lua_rawgeti(L, 2, i);
+    SidlFieldType sidl_field_type;
+    const char *field_name = sidlobj_check_field(L, ud, -1, &sidl_field_type);
+    SidlValue value = SidlAPI_GetFieldValue(ud->instance_id, field_name);
+    lua_pop(L, 1);
+    xlua_pushsidlvalue(L, sidl_field_type, value);  // Return(i): FieldValue
+  }
+  return count;
+}
+
+/// @brief 批量写入SidlObject字段，key可以是字段名或字段句柄
+/// @note 按遍历顺序逐个写入，遇到不存在的字段或类型不匹配时报错，此前的字段已写入
+/// @example sidlrt.setfields(obj, {count = 1, name = "item"})
+static int sidlrt_set_fields(lua_State *L) {
+  if (!xlua_checksidlobj(L, 1, SidlInstanceType::OBJECT)) {
+    return luaL_error(L, "SidlObject type doesn't match");
+  }
+  luaL_checktype(L, 2, LUA_TTABLE);
+  SidlInstanceUserData *ud = (SidlInstanceUserData *)lua_touserdata(L, 1);  // R(1): UserData
+  lua_settop(L, 2);                                                          // R(2): Fields
+  lua_pushnil(L);
+  while (lua_next(L, 2) != 0) {
+    // 复制一份key再解析，避免lua_tostring把数字key原地转成字符串打乱lua_next
+    lua_pushvalue(L, -2);  // R(5): Key
+    SidlFieldType sidl_field_type;
+    const char *field_name = sidlobj_check_field(L, ud, 5, &sidl_field_type);
+    if (!xlua_issidlvalue(L, 4, sidl_field_type)) {  // R(4): Value
+      return luaL_error(L, "The field \"%s\" value doesn't match type", field_name);
+    }
+    SidlValue value = xlua_tosidlvalue(L, 4, sidl_field_type);
+    SidlAPI_SetFieldValue(ud->instance_id, field_name, value);
+    lua_pop(L, 2);
+  }
+  return 0;
+}
+
+static int sidlfieldhandle_tostring(lua_State *L) {
+  SidlFieldHandle *handle = (SidlFieldHandle *)lua_touserdata(L, 1);  // R(1): FieldHandle
+  lua_pushfstring(L, "SidlFieldHandle: %s.%s", handle->meta_name, handle->field_name);
+  return 1;
+}
+
+/// @brief 创建字段句柄，可用于obj[handle]、sidlrt.getfields、sidlrt.setfields，省去每次按字段名查询字段类型
+/// @example local COUNT = sidlrt.fieldhandle("TK.ItemData", "count")
+static int sidlrt_field_handle(lua_State *L) {
+  if (!lua_isstring(L, 1)) {
+    return luaL_error(L, "SidlObject type name doesn't match string type");
+  }
+  if (!lua_isstring(L, 2)) {
+    return luaL_error(L, "Field name doesn't match string type");
+  }
+  size_t meta_len, field_len;
+  const char *meta_name = lua_tolstring(L, 1, &meta_len);    // R(1): TypeName
+  const char *field_name = lua_tolstring(L, 2, &field_len);  // R(2): FieldName
+  SidlFieldHandle *handle =
+      (SidlFieldHandle *)lua_newuserdata(L, sizeof(SidlFieldHandle) + meta_len + 1 + field_len + 1);
+  char *names = (char *)(handle + 1);
+  memcpy(names, meta_name, meta_len + 1);
+  memcpy(names + meta_len + 1, field_name, field_len + 1);
+  xlua_memstats_udata(L, handle, MEM_SIDL);
+  handle->field_type = SidlFieldType::UNKNOWN;
+  handle->meta_name = names;
+  handle->field_name = names + meta_len + 1;
+  if (luaL_newmetatable(L, field_handle_tname)) {
+    lua_pushcfunction(L, sidlfieldhandle_tostring);
+    lua_setfield(L, -2, "__tostring");
+  }
+  lua_setmetatable(L, -2);
+  return 1;  // Return(1): FieldHandle
+}
+
+/// @brief 字段类型缓存命中次数(即省下的SidlAPI_GetFieldType调用)和未命中次数
+/// @example local hits, misses = sidlrt.fieldcachestats(true)
+static int sidlrt_field_cache_stats(lua_State *L) {
+  uint64_t hits, misses;
+  xlua_sidl_field_cache_stats(&hits, &misses, lua_toboolean(L, 1));  // R(1): reset
+  lua_pushnumber(L, (lua_Number)hits);                                // Return(1): hits
+  lua_pushnumber(L, (lua_Number)misses);                              // Return(2): misses
+  return 2;
+}
+
 static const luaL_Reg sidlrtlib[] = {{"getinstanceid", sidlrt_get_instance_id},
                                      {"getmetaname", sidlrt_get_meta_name},
                                      {"getmodelmetadata", sidlrt_get_model_meta_data},
@@ -605,6 +1266,12 @@ static const luaL_Reg sidlrtlib[] = {{"getinstanceid", sidlrt_get_instance_id},
                                      {"clearmap", sidlrt_clear_map},
                                      {"containsmapkey", sidlrt_contains_map_key},
                                      {"removemapkey", sidlrt_remove_map_key},
+                                     {"totable", sidlrt_to_table},
+                                     {"fromtable", sidlrt_from_table},
+                                     {"getfields", sidlrt_get_fields},
+                                     {"setfields", sidlrt_set_fields},
+                                     {"fieldhandle", sidlrt_field_handle},
+                                     {"fieldcachestats", sidlrt_field_cache_stats},
                                      {NULL, NULL}};
 
 EXPORT void CALL luaopen_sidlrt(lua_State *L) {
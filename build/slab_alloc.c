@@ -0,0 +1,461 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) 2024 - present handsomesnail
+ *  Licensed under the MIT License. See LICENSE in the project root for more information.
+ *--------------------------------------------------------------------------------------------*/
+
+#define LUA_LIB
+
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab_alloc.h"
+
+#if USING_LUAJIT
+#include "lj_obj.h"
+#if LJ_64 && !LJ_GC64
+#define SLAB_UNSUPPORTED  // x64 LuaJIT without GC64 refuses custom allocators, it keeps its own lj_alloc
+#endif
+#else
+#include "lstate.h"
+#endif
+
+/*
+** size-class slab allocator for states created by xlua_newstate
+**
+** Blocks up to SLAB_MAX_SIZE bytes (short strings, closures, upvalues, tables, csobj/sidl userdata) come from per
+** size class free lists carved out of SLAB_CHUNK_SIZE aligned chunks, bigger ones go to malloc behind a small
+** header. Every state has its own allocator so there is no locking, and lua always passes the old size back, so
+** small blocks carry no header. Chunks are only returned to the system when the state is closed.
+**
+** Every block also remembers its memory tag (MEM_*): the gc type lua 5.3/5.4 pass in osize for new objects, or the
+** userdata kind set afterwards by xlua_memstats_udata, so live bytes can be reported per tag without a heap walk.
+*/
+
+#define SLAB_MAX_SIZE 256
+#define SLAB_CHUNK_SIZE (16 * 1024)  // also the alignment, so a block finds its chunk header by masking
+#define SLAB_CLASS_COUNT 17
+#define SLAB_LARGE (SLAB_CLASS_COUNT - 1)  // accounts blocks above SLAB_MAX_SIZE
+
+static const unsigned int slab_class_size[SLAB_CLASS_COUNT] = {8,  16, 24,  32,  40,  48,  56,  64, 80,
+                                                                96, 112, 128, 160, 192, 224, 256, 0};
+
+static const char *const memstats_names[MEM_TAG_COUNT] = {"other",  "string",  "table", "function", "userdata",
+                                                          "thread", "proto",   "upvalue", "csobj",  "struct",
+                                                          "int64",  "sidl",    "typedarray"};
+
+typedef struct SlabBlock {
+  struct SlabBlock *next;
+} SlabBlock;
+
+typedef struct SlabChunk {
+  struct SlabChunk *next;
+  unsigned int first;  // offset of the first block, after the header and the tags
+  unsigned int block_size;
+  unsigned char tags[1];  // one per block
+} SlabChunk;
+
+typedef union {
+  unsigned char tag;
+  double align;  // keeps the block behind the header aligned like malloc
+  char pad[16];
+} SlabLargeHeader;
+
+typedef struct {
+  SlabBlock *free_list;
+  char *bump;  // unused tail of the newest chunk
+  char *bump_end;
+  uint64_t live_bytes;  // as requested by lua
+  uint64_t live_blocks;
+  uint64_t reserved_bytes;  // chunk memory handed to this class
+} SlabClass;
+
+typedef struct {
+  uint64_t live_bytes;
+  uint64_t live_blocks;
+} SlabTag;
+
+typedef struct {
+  SlabClass classes[SLAB_CLASS_COUNT];
+  SlabTag tags[MEM_TAG_COUNT];
+  SlabChunk *chunks;
+  void *main_block;  // first allocation of lua_newstate, lua frees it last in lua_close
+  int *destroyed;  // set while lua_newstate runs, which frees the main block itself when it fails
+  unsigned char class_of[SLAB_MAX_SIZE / 8 + 1];
+} SlabAllocator;
+
+static void *slab_chunk_alloc() {
+#if defined(_WIN32) || defined(_WIN64)
+  return _aligned_malloc(SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE);
+#else
+  void *p = NULL;
+  return posix_memalign(&p, SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE) == 0 ? p : NULL;
+#endif
+}
+
+static void slab_chunk_free(void *p) {
+#if defined(_WIN32) || defined(_WIN64)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+static int slab_class(SlabAllocator *sa, size_t size) {
+  return size <= SLAB_MAX_SIZE ? sa->class_of[(size + 7) >> 3] : SLAB_LARGE;
+}
+
+static unsigned char *slab_tag_of(void *ptr, int cls) {
+  SlabChunk *chunk;
+  if (cls == SLAB_LARGE) {
+    return &((SlabLargeHeader *)ptr - 1)->tag;
+  }
+  chunk = (SlabChunk *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1));
+  return &chunk->tags[((char *)ptr - (char *)chunk - chunk->first) / chunk->block_size];
+}
+
+static void *slab_get(SlabAllocator *sa, int cls) {
+  SlabClass *sc = &sa->classes[cls];
+  SlabBlock *block = sc->free_list;
+  if (block != NULL) {
+    sc->free_list = block->next;
+    return block;
+  }
+  if (sc->bump + slab_class_size[cls] > sc->bump_end) {
+    unsigned int size = slab_class_size[cls];
+    unsigned int blocks = (SLAB_CHUNK_SIZE - offsetof(SlabChunk, tags)) / (size + 1);
+    SlabChunk *chunk = (SlabChunk *)slab_chunk_alloc();
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->next = sa->chunks;
+    chunk->block_size = size;
+    chunk->first = (offsetof(SlabChunk, tags) + blocks + 15) & ~15u;
+    while (chunk->first + blocks * size > SLAB_CHUNK_SIZE) {
+      blocks--;
+    }
+    sa->chunks = chunk;
+    sc->bump = (char *)chunk + chunk->first;
+    sc->bump_end = sc->bump + blocks * size;
+    sc->reserved_bytes += SLAB_CHUNK_SIZE;
+  }
+  block = (SlabBlock *)sc->bump;
+  sc->bump += slab_class_size[cls];
+  return block;
+}
+
+static void slab_put(SlabAllocator *sa, int cls, void *ptr) {
+  SlabBlock *block = (SlabBlock *)ptr;
+  block->next = sa->classes[cls].free_list;
+  sa->classes[cls].free_list = block;
+}
+
+static void *slab_new(SlabAllocator *sa, int cls, size_t size) {
+  SlabLargeHeader *header;
+  if (cls != SLAB_LARGE) {
+    return slab_get(sa, cls);
+  }
+  header = (SlabLargeHeader *)malloc(sizeof(SlabLargeHeader) + size);
+  return header == NULL ? NULL : header + 1;
+}
+
+static void slab_delete(SlabAllocator *sa, int cls, void *ptr) {
+  if (cls == SLAB_LARGE) {
+    free((SlabLargeHeader *)ptr - 1);
+  } else {
+    slab_put(sa, cls, ptr);
+  }
+}
+
+static void slab_destroy(SlabAllocator *sa) {
+  while (sa->chunks != NULL) {
+    SlabChunk *next = sa->chunks->next;
+    slab_chunk_free(sa->chunks);
+    sa->chunks = next;
+  }
+  if (sa->destroyed != NULL) {
+    *sa->destroyed = 1;
+  }
+  free(sa);
+}
+
+static void slab_account(SlabAllocator *sa, int cls, int tag, size_t size, int sign) {
+  SlabClass *sc = &sa->classes[cls];
+  SlabTag *st = &sa->tags[tag];
+  if (sign > 0) {
+    sc->live_bytes += size;
+    sc->live_blocks++;
+    st->live_bytes += size;
+    st->live_blocks++;
+    if (cls == SLAB_LARGE) {
+      sc->reserved_bytes += sizeof(SlabLargeHeader) + size;
+    }
+  } else {
+    sc->live_bytes -= size;
+    sc->live_blocks--;
+    st->live_bytes -= size;
+    st->live_blocks--;
+    if (cls == SLAB_LARGE) {
+      sc->reserved_bytes -= sizeof(SlabLargeHeader) + size;
+    }
+  }
+}
+
+// the type lua 5.3/5.4 pass as osize when creating a gc object, 0 (other) for everything else
+static int slab_tag_of_type(size_t type) {
+#if LUA_VERSION_NUM >= 503 && !USING_LUAJIT
+  switch (type) {
+    case LUA_TSTRING:
+      return MEM_STRING;
+    case LUA_TTABLE:
+      return MEM_TABLE;
+    case LUA_TFUNCTION:
+      return MEM_FUNCTION;
+    case LUA_TUSERDATA:
+      return MEM_USERDATA;
+    case LUA_TTHREAD:
+      return MEM_THREAD;
+    case LUA_TPROTO:
+      return MEM_PROTO;
+#if defined(LUA_TUPVAL)
+    case LUA_TUPVAL:
+      return MEM_UPVALUE;
+#endif
+    default:
+      break;
+  }
+#else
+  (void)type;
+#endif
+  return MEM_OTHER;
+}
+
+static void *slab_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  SlabAllocator *sa = (SlabAllocator *)ud;
+  int ocls, ncls, tag;
+  void *nptr;
+
+  if (ptr == NULL) {
+    if (nsize == 0) {
+      return NULL;
+    }
+    ncls = slab_class(sa, nsize);
+    tag = slab_tag_of_type(osize);
+    nptr = slab_new(sa, ncls, nsize);
+    if (nptr != NULL) {
+      *slab_tag_of(nptr, ncls) = (unsigned char)tag;
+      slab_account(sa, ncls, tag, nsize, 1);
+      if (sa->main_block == NULL) {
+        sa->main_block = nptr;
+      }
+    }
+    return nptr;
+  }
+
+  ocls = slab_class(sa, osize);
+  tag = *slab_tag_of(ptr, ocls);
+  if (nsize == 0) {
+    slab_account(sa, ocls, tag, osize, -1);
+    slab_delete(sa, ocls, ptr);
+    if (ptr == sa->main_block) {
+      slab_destroy(sa);
+    }
+    return NULL;
+  }
+
+  ncls = slab_class(sa, nsize);
+  if (ocls == ncls) {
+    if (ncls == SLAB_LARGE) {
+      SlabLargeHeader *header = (SlabLargeHeader *)realloc((SlabLargeHeader *)ptr - 1, sizeof(SlabLargeHeader) + nsize);
+      if (header == NULL) {
+        return NULL;
+      }
+      nptr = header + 1;
+    } else {
+      nptr = ptr;
+    }
+  } else {
+    nptr = slab_new(sa, ncls, nsize);
+    if (nptr == NULL) {
+      return NULL;
+    }
+    memcpy(nptr, ptr, osize < nsize ? osize : nsize);
+    *slab_tag_of(nptr, ncls) = (unsigned char)tag;
+    slab_delete(sa, ocls, ptr);
+  }
+  slab_account(sa, ocls, tag, osize, -1);
+  slab_account(sa, ncls, tag, nsize, 1);
+  return nptr;
+}
+
+#ifndef SLAB_UNSUPPORTED
+static int slab_panic(lua_State *L) {
+  fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+  fflush(stderr);
+  return 0;
+}
+#endif
+
+// like luaL_newstate but on a slab allocator owned by the state, same as luaL_newstate where the VM does not take
+// custom allocators
+LUA_API lua_State *xlua_newstate() {
+#ifdef SLAB_UNSUPPORTED
+  return luaL_newstate();
+#else
+  int cls, destroyed = 0;
+  unsigned int size;
+  lua_State *L;
+  SlabAllocator *sa = (SlabAllocator *)calloc(1, sizeof(SlabAllocator));
+  if (sa == NULL) {
+    return NULL;
+  }
+  for (size = 0, cls = 0; size <= SLAB_MAX_SIZE; size += 8) {
+    while (slab_class_size[cls] < size) {
+      cls++;
+    }
+    sa->class_of[size >> 3] = (unsigned char)cls;
+  }
+  sa->destroyed = &destroyed;
+  L = lua_newstate(slab_alloc, sa);
+  if (L == NULL) {
+    if (!destroyed) {
+      slab_destroy(sa);
+    }
+    return NULL;
+  }
+  sa->destroyed = NULL;
+  lua_atpanic(L, slab_panic);
+  return L;
+#endif
+}
+
+static SlabAllocator *slab_of(lua_State *L) {
+  void *ud = NULL;
+  return lua_getallocf(L, &ud) == slab_alloc ? (SlabAllocator *)ud : NULL;
+}
+
+// number of size classes reported by xlua_alloc_stats, the last one holds blocks above SLAB_MAX_SIZE (block_size 0)
+LUA_API int xlua_alloc_class_count() { return SLAB_CLASS_COUNT; }
+
+// returns 0 when cls is out of range or L was not created by xlua_newstate
+LUA_API int xlua_alloc_stats(lua_State *L, int cls, unsigned int *block_size, uint64_t *live_bytes,
+                             uint64_t *live_blocks, uint64_t *reserved_bytes) {
+  SlabAllocator *sa = slab_of(L);
+  SlabClass *sc;
+  if (sa == NULL || cls < 0 || cls >= SLAB_CLASS_COUNT) {
+    return 0;
+  }
+  sc = &sa->classes[cls];
+  *block_size = slab_class_size[cls];
+  *live_bytes = sc->live_bytes;
+  *live_blocks = sc->live_blocks;
+  *reserved_bytes = sc->reserved_bytes;
+  return 1;
+}
+
+// xlua.allocstats() -> {{size = 8, live = bytes, blocks = n, reserved = bytes}, ...} or nil if not on the slab allocator
+int slab_alloc_stats(lua_State *L) {
+  int cls, count = xlua_alloc_class_count();
+  unsigned int block_size;
+  uint64_t live_bytes, live_blocks, reserved_bytes;
+  if (slab_of(L) == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_createtable(L, count, 0);
+  for (cls = 0; cls < count; cls++) {
+    xlua_alloc_stats(L, cls, &block_size, &live_bytes, &live_blocks, &reserved_bytes);
+    lua_createtable(L, 0, 4);
+    lua_pushnumber(L, (lua_Number)block_size);
+    lua_setfield(L, -2, "size");
+    lua_pushnumber(L, (lua_Number)live_bytes);
+    lua_setfield(L, -2, "live");
+    lua_pushnumber(L, (lua_Number)live_blocks);
+    lua_setfield(L, -2, "blocks");
+    lua_pushnumber(L, (lua_Number)reserved_bytes);
+    lua_setfield(L, -2, "reserved");
+    lua_rawseti(L, -2, cls + 1);
+  }
+  return 1;
+}
+
+// the memory block behind the payload of a full userdata created by lua_newuserdata, and its size
+static void *slab_udata_block(void *p, size_t *size) {
+#if USING_LUAJIT
+  GCudata *u = (GCudata *)p - 1;
+  *size = sizeudata(u);
+#elif LUA_VERSION_NUM == 501
+  Udata *u = (Udata *)p - 1;
+  *size = sizeof(Udata) + u->uv.len;
+#elif LUA_VERSION_NUM == 503
+  Udata *u = (Udata *)((char *)p - sizeof(UUdata));
+  *size = sizeof(UUdata) + u->len;
+#else
+  Udata *u = (Udata *)((char *)p - udatamemoffset(1));
+  *size = sizeudata(1, u->len);
+#endif
+  return u;
+}
+
+// attributes the userdata p (just returned by lua_newuserdata) to kind MEM_CSOBJ..MEM_TYPEDARRAY
+LUA_API void xlua_memstats_udata(lua_State *L, void *p, int kind) {
+  SlabAllocator *sa = slab_of(L);
+  unsigned char *tag;
+  size_t size;
+  void *block;
+  int cls;
+  if (sa == NULL || kind < 0 || kind >= MEM_TAG_COUNT) {
+    return;
+  }
+  block = slab_udata_block(p, &size);
+  cls = slab_class(sa, size);
+  tag = slab_tag_of(block, cls);
+  sa->tags[*tag].live_bytes -= size;
+  sa->tags[*tag].live_blocks--;
+  sa->tags[kind].live_bytes += size;
+  sa->tags[kind].live_blocks++;
+  *tag = (unsigned char)kind;
+}
+
+// live bytes and blocks of a memory tag (MEM_*), returns 0 when tag is out of range or L was not created by
+// xlua_newstate
+LUA_API int xlua_memstats(lua_State *L, int tag, uint64_t *live_bytes, uint64_t *live_blocks) {
+  SlabAllocator *sa = slab_of(L);
+  if (sa == NULL || tag < 0 || tag >= MEM_TAG_COUNT) {
+    return 0;
+  }
+  *live_bytes = sa->tags[tag].live_bytes;
+  *live_blocks = sa->tags[tag].live_blocks;
+  return 1;
+}
+
+// xlua.memstats([bytes [, blocks]]) -> bytes, blocks: live bytes and block counts keyed by tag name ("table",
+// "csobj", ...), reusing the tables passed in so polling it creates no garbage. nil if not on the slab allocator
+int slab_mem_stats(lua_State *L) {
+  SlabAllocator *sa = slab_of(L);
+  int tag;
+  if (sa == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_settop(L, 2);
+  if (!lua_istable(L, 1)) {
+    lua_createtable(L, 0, MEM_TAG_COUNT);
+    lua_replace(L, 1);
+  }
+  if (!lua_istable(L, 2)) {
+    lua_createtable(L, 0, MEM_TAG_COUNT);
+    lua_replace(L, 2);
+  }
+  for (tag = 0; tag < MEM_TAG_COUNT; tag++) {
+    lua_pushnumber(L, (lua_Number)sa->tags[tag].live_bytes);
+    lua_setfield(L, 1, memstats_names[tag]);
+    lua_pushnumber(L, (lua_Number)sa->tags[tag].live_blocks);
+    lua_setfield(L, 2, memstats_names[tag]);
+  }
+  return 2;
+}
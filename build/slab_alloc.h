@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) 2024 - present handsomesnail
+ *  Licensed under the MIT License. See LICENSE in the project root for more information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SLAB_ALLOC_H
+#define SLAB_ALLOC_H
+
+#include <stdint.h>
+#include "lua.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// memory tags of xlua.memstats: gc object types (lua 5.3/5.4 only, everything is "other" on 5.1 and LuaJIT), then
+// the kinds userdata gets attributed to by its creator
+#define MEM_OTHER 0  // table parts, stacks, string table, buffers...
+#define MEM_STRING 1
+#define MEM_TABLE 2
+#define MEM_FUNCTION 3
+#define MEM_USERDATA 4
+#define MEM_THREAD 5
+#define MEM_PROTO 6
+#define MEM_UPVALUE 7
+#define MEM_CSOBJ 8
+#define MEM_STRUCT 9  // CSharpStruct
+#define MEM_INT64 10
+#define MEM_SIDL 11
+#define MEM_TYPEDARRAY 12
+#define MEM_TAG_COUNT 13
+
+LUA_API lua_State *xlua_newstate();
+LUA_API void xlua_memstats_udata(lua_State *L, void *p, int kind);
+LUA_API int xlua_memstats(lua_State *L, int tag, uint64_t *live_bytes, uint64_t *live_blocks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
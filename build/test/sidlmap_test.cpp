@@ -0,0 +1,137 @@
+/*
+ *Tencent is pleased to support the open source community by making xLua available.
+ *Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ *Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You
+ *may obtain a copy of the License at http://opensource.org/licenses/MIT Unless required by applicable law or agreed to
+ *in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+// SidlMap pairs/next over the per-state cursor pool of sidlrt.cpp, every case is a lua chunk that errors on failure.
+// Cases with close_checks also expect that many close_check(true) calls from finalizers run by lua_close.
+// usage: xlua_test_sidlmap [filter]
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+}
+
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+lua_State *xlua_newstate();
+void luaopen_xlua(lua_State *L);
+void luaopen_sidlrt(lua_State *L);
+}
+
+namespace {
+
+// m: SidlMap<string, int> holding k1..k5 = 1..5, count(m): number of pairs() steps
+// (luajit without LUAJIT_ENABLE_LUA52COMPAT ignores __pairs, so pairs is wrapped there)
+const char *prelude =
+    "if _VERSION == 'Lua 5.1' then local raw = pairs\n"
+    "  function pairs(t) local mt = getmetatable(t) return (mt and mt.__pairs or raw)(t) end\n"
+    "end\n"
+    "local INT, STRING = 1, 6\n"
+    "function newmap() local m = sidlrt.newmap(STRING, INT, '', '') for i = 1, 5 do m['k' .. i] = i end return m end\n"
+    "function count(m) local n = 0 for k, v in pairs(m) do assert(m[k] == v) n = n + 1 end return n end\n";
+
+struct Case {
+  const char *name;
+  const char *chunk;
+  int close_checks;
+};
+
+int close_passed = 0;
+int close_failed = 0;
+
+int close_check(lua_State *L) {
+  if (lua_toboolean(L, 1)) {
+    close_passed++;
+  } else {
+    close_failed++;
+  }
+  return 0;
+}
+
+const Case cases[] = {
+    {"full iteration", "local m = newmap() assert(count(m) == 5)"},
+    {"nested", "local m = newmap() local n = 0 for a in pairs(m) do for b in pairs(m) do n = n + 1 end end\n"
+               "assert(n == 25)"},
+    {"break, modify, iterate",
+     // the broken loop leaves a cursor on the first key, the next loop must not pick it up
+     "local m = newmap()\n"
+     "for k in pairs(m) do break end\n"
+     "m.k6 = 6\n"
+     "assert(count(m) == 6)\n"
+     "for k in pairs(m) do break end\n"
+     "sidlrt.removemapkey(m, 'k6')\n"
+     "assert(count(m) == 5)"},
+    {"break, modify, next",
+     // continuing a loop by hand after the map changed is still a modification during iteration
+     "local m = newmap() local nf = pairs(m)\n"
+     "local k1 = nf(m, nil)\n"
+     "m[k1] = 10\n"
+     "local ok, err = pcall(nf, m, k1)\n"
+     "assert(not ok and err:find('modified during iteration'), err)\n"
+     "assert(count(m) == 5)"},
+    {"modify during iteration",
+     "local m = newmap() local n = 0\n"
+     "local ok, err = pcall(function() for k, v in pairs(m) do m[k] = v * 2 n = n + 1 end end)\n"
+     "assert(not ok and err:find('modified during iteration'), err) assert(n == 1, n)\n"
+     "ok, err = pcall(function() for k in pairs(m) do m.k6 = 6 end end)\n"
+     "assert(not ok and err:find('modified during iteration'), err)\n"
+     "assert(count(m) == 6)"},
+    {"many broken loops",
+     "local m = newmap()\n"
+     "for r = 1, 40 do for k in pairs(m) do break end m['r' .. r] = r end\n"
+     "assert(count(m) == 45)"},
+    {"push while closing",
+     // holder's __gc is set before the state cache is created, so lua_close runs it after the cache is released
+     "local function gc()\n"
+     "  local m = sidlrt.newmap(6, 1, '', '') m.k = 1\n"
+     "  close_check(m.k == 1)\n"
+     "  close_check(not pcall(pairs, m))\n"
+     "end\n"
+     "if newproxy then holder = newproxy(true) getmetatable(holder).__gc = gc\n"
+     "else holder = setmetatable({}, {__gc = gc}) end\n"
+     "assert(count(newmap()) == 5)",
+     2},
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const Case &c = cases[i];
+    if (filter != NULL && strstr(c.name, filter) == NULL) {
+      continue;
+    }
+    // a fresh state per case, so cursors left behind by one case don't hide bugs in the next
+    lua_State *L = xlua_newstate();
+    luaL_openlibs(L);
+    luaopen_xlua(L);
+    luaopen_sidlrt(L);
+    lua_register(L, "close_check", close_check);
+    close_passed = close_failed = 0;
+    if (luaL_dostring(L, prelude) || luaL_dostring(L, c.chunk)) {
+      printf("FAIL %s: %s\n", c.name, lua_tostring(L, -1));
+      failed++;
+      lua_close(L);
+      continue;
+    }
+    lua_close(L);
+    if (close_passed != c.close_checks || close_failed != 0) {
+      printf("FAIL %s: %d of %d checks passed while closing\n", c.name, close_passed, c.close_checks);
+      failed++;
+    } else {
+      printf("ok   %s\n", c.name);
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}
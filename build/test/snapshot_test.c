@@ -0,0 +1,386 @@
+/*
+ *Tencent is pleased to support the open source community by making xLua available.
+ *Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ *Licensed under the MIT License (the "License"); you may not use this file except in compliance with the License. You
+ *may obtain a copy of the License at http://opensource.org/licenses/MIT Unless required by applicable law or agreed to
+ *in writing, software distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *CONDITIONS OF ANY KIND, either express or implied. See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+// heap snapshots of memory_leak_checker.c: serialize/load, diff with retention paths, retained sizes and the recorded
+// edges, every case runs on a fresh state
+// usage: xlua_test_snapshot [filter]
+
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct HeapSnapshot HeapSnapshot;
+typedef struct HeapDiff HeapDiff;
+
+// same layout as in memory_leak_checker.c, the serialized snapshot is header, objects, edges, strings
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t object_count;
+  uint32_t edge_count;
+  uint32_t string_count;
+  uint32_t string_bytes;
+  uint64_t registry;
+  uint64_t global;
+} SnapshotHeader;
+
+typedef struct {
+  uint64_t id;
+  uint32_t bytes;
+  uint32_t count;
+  uint32_t type;
+  uint32_t reserved;
+} SnapshotObject;
+
+typedef struct {
+  uint64_t parent;
+  uint64_t child;
+  double d;
+  uint32_t type;
+  int32_t key;
+  int32_t key2;
+  uint32_t reserved;
+} SnapshotEdge;
+
+typedef struct {
+  uint64_t id;
+  uint64_t retained;
+  uint32_t type;
+  uint32_t bytes;
+  uint32_t count_from;
+  uint32_t count_to;
+  int32_t path;
+  uint32_t reserved;
+} HeapDiffEntry;
+
+extern HeapSnapshot *xlua_heap_snapshot(lua_State *L);
+extern void xlua_snapshot_free(HeapSnapshot *snap);
+extern const void *xlua_snapshot_serialize(HeapSnapshot *snap, int *size);
+extern HeapSnapshot *xlua_snapshot_load(const void *buf, int size);
+extern HeapDiff *xlua_snapshot_diff(const HeapSnapshot *from, const HeapSnapshot *to);
+extern const HeapDiffEntry *xlua_snapshotdiff_entries(HeapDiff *diff, int *count);
+extern const char *xlua_snapshotdiff_strings(HeapDiff *diff, int *size);
+extern void xlua_snapshotdiff_free(HeapDiff *diff);
+extern HeapDiff *xlua_snapshot_retainers(const HeapSnapshot *snap, int max_count);
+
+static char failure[512];
+
+#define CHECK(cond)                                                              \
+  do {                                                                           \
+    if (!(cond)) {                                                               \
+      snprintf(failure, sizeof(failure), "line %d: %s", __LINE__, #cond);        \
+      return failure;                                                            \
+    }                                                                            \
+  } while (0)
+
+#define CHECK_LUA(L, chunk)                                                      \
+  do {                                                                           \
+    if (luaL_dostring(L, chunk)) {                                               \
+      snprintf(failure, sizeof(failure), "line %d: %s", __LINE__, lua_tostring(L, -1)); \
+      return failure;                                                            \
+    }                                                                            \
+  } while (0)
+
+static const void *global_pointer(lua_State *L, const char *name) {
+  const void *p;
+  lua_getglobal(L, name);
+  p = lua_topointer(L, -1);
+  lua_pop(L, 1);
+  return p;
+}
+
+// snapshot copied out through serialize and read back with load, the copy is returned in *buf
+static HeapSnapshot *round_trip(HeapSnapshot *snap, char **buf, int *size) {
+  const void *serialized = xlua_snapshot_serialize(snap, size);
+  if (serialized == NULL) {
+    return NULL;
+  }
+  *buf = (char *)malloc(*size);
+  memcpy(*buf, serialized, *size);
+  return xlua_snapshot_load(*buf, *size);
+}
+
+static const HeapDiffEntry *find_entry(HeapDiff *diff, uint64_t id) {
+  int count, i;
+  const HeapDiffEntry *entries = xlua_snapshotdiff_entries(diff, &count);
+  for (i = 0; i < count; i++) {
+    if (entries[i].id == id) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+// the serialized parts of a snapshot, valid until the snapshot is serialized again or freed
+typedef struct {
+  SnapshotHeader header;
+  const SnapshotObject *objects;
+  const SnapshotEdge *edges;
+} SnapshotView;
+
+static int snapshot_view(HeapSnapshot *snap, SnapshotView *view) {
+  int size;
+  const char *buf = (const char *)xlua_snapshot_serialize(snap, &size);
+  if (buf == NULL) {
+    return 0;
+  }
+  memcpy(&view->header, buf, sizeof(SnapshotHeader));
+  view->objects = (const SnapshotObject *)(buf + sizeof(SnapshotHeader));
+  view->edges = (const SnapshotEdge *)(view->objects + view->header.object_count);
+  return 1;
+}
+
+static uint64_t object_bytes(const SnapshotView *view, const void *p) {
+  uint32_t i;
+  for (i = 0; i < view->header.object_count; i++) {
+    if (view->objects[i].id == (uint64_t)(size_t)p) {
+      return view->objects[i].bytes;
+    }
+  }
+  return 0;
+}
+
+static const SnapshotEdge *find_edge(const SnapshotView *view, const void *parent, const void *child, uint32_t type) {
+  uint32_t i;
+  for (i = 0; i < view->header.edge_count; i++) {
+    const SnapshotEdge *edge = &view->edges[i];
+    if ((parent == NULL || edge->parent == (uint64_t)(size_t)parent) && edge->child == (uint64_t)(size_t)child
+        && edge->type == type) {
+      return edge;
+    }
+  }
+  return NULL;
+}
+
+static uint64_t retained(HeapDiff *retainers, const void *p) {
+  const HeapDiffEntry *entry = find_entry(retainers, (uint64_t)(size_t)p);
+  return entry == NULL ? 0 : entry->retained;
+}
+
+static int ends_with(const char *str, const char *suffix) {
+  size_t len = strlen(str), suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+static const char *test_diff(lua_State *L) {
+  HeapSnapshot *from, *to, *from_loaded, *to_loaded;
+  HeapDiff *diff;
+  const HeapDiffEntry *leak, *up;
+  const char *strings;
+  char *from_buf, *to_buf;
+  int from_size, to_size, size, string_size;
+  const void *reserialized;
+  uint64_t up_id;
+
+  CHECK_LUA(L, "leak = {}\n"
+               "local up = {}\n"
+               "function grow(n) for i = 1, n do up[#up + 1] = {} end end\n"
+               "function get_up() return up end");
+  lua_getglobal(L, "get_up");
+  lua_call(L, 0, 1);
+  up_id = (uint64_t)(size_t)lua_topointer(L, -1);
+  lua_pop(L, 1);
+  from = xlua_heap_snapshot(L);
+  CHECK(from != NULL);
+  CHECK_LUA(L, "for i = 1, 100 do leak[i] = {} end grow(50)");
+  to = xlua_heap_snapshot(L);
+  CHECK(to != NULL);
+
+  // load(serialize(snap)) serializes back to the same bytes
+  from_loaded = round_trip(from, &from_buf, &from_size);
+  to_loaded = round_trip(to, &to_buf, &to_size);
+  CHECK(from_loaded != NULL && to_loaded != NULL);
+  reserialized = xlua_snapshot_serialize(to_loaded, &size);
+  CHECK(reserialized != NULL && size == to_size && memcmp(reserialized, to_buf, size) == 0);
+
+  diff = xlua_snapshot_diff(from_loaded, to_loaded);
+  CHECK(diff != NULL);
+  strings = xlua_snapshotdiff_strings(diff, &string_size);
+  leak = find_entry(diff, (uint64_t)(size_t)global_pointer(L, "leak"));
+  CHECK(leak != NULL);
+  CHECK(leak->count_from == 0 && leak->count_to == 100);
+  CHECK(leak->path >= 0 && strcmp(strings + leak->path, "_G.leak") == 0);
+  up = find_entry(diff, up_id);
+  CHECK(up != NULL);
+  CHECK(up->count_from == 0 && up->count_to == 50);
+  CHECK(up->path >= 0 && ends_with(strings + up->path, ":local up"));
+  // largest growth first
+  CHECK(xlua_snapshotdiff_entries(diff, &size) == leak);
+
+  xlua_snapshotdiff_free(diff);
+  xlua_snapshot_free(from);
+  xlua_snapshot_free(to);
+  xlua_snapshot_free(from_loaded);
+  xlua_snapshot_free(to_loaded);
+  free(from_buf);
+  free(to_buf);
+  return NULL;
+}
+
+static const char *test_load_rejects(lua_State *L) {
+  HeapSnapshot *snap = xlua_heap_snapshot(L);
+  char *buf;
+  int size;
+  const void *serialized;
+  CHECK(snap != NULL);
+  serialized = xlua_snapshot_serialize(snap, &size);
+  CHECK(serialized != NULL);
+  buf = (char *)malloc(size);
+  memcpy(buf, serialized, size);
+
+  CHECK(xlua_snapshot_load(buf, size - 1) == NULL);  // truncated strings
+  CHECK(xlua_snapshot_load(buf, size / 2) == NULL);  // truncated objects or edges
+  CHECK(xlua_snapshot_load(buf, 16) == NULL);        // truncated header
+  buf[size - 1] = 'x';                               // unterminated last string
+  CHECK(xlua_snapshot_load(buf, size) == NULL);
+  buf[size - 1] = '\0';
+  buf[0] = 'Y';  // magic
+  CHECK(xlua_snapshot_load(buf, size) == NULL);
+
+  free(buf);
+  xlua_snapshot_free(snap);
+  return NULL;
+}
+
+// the tables involved hold no strings, so their retained sizes can be summed up by hand
+static const char *test_retained(lua_State *L) {
+  HeapSnapshot *snap;
+  HeapDiff *retainers;
+  SnapshotView view;
+  const void *a, *b, *c, *top, *left, *right, *shared, *weak, *mt, *payload;
+
+  CHECK_LUA(L, "chain = {{{}}}\n"
+               "local shared = {} diamond = {{shared}, {shared}}\n"
+               "weak = setmetatable({{}}, {__mode = 'v'})");
+  CHECK_LUA(L, "return chain, chain[1], chain[1][1], diamond, diamond[1], diamond[2], diamond[1][1], weak,\n"
+               "  getmetatable(weak), weak[1]");
+  a = lua_topointer(L, -10);
+  b = lua_topointer(L, -9);
+  c = lua_topointer(L, -8);
+  top = lua_topointer(L, -7);
+  left = lua_topointer(L, -6);
+  right = lua_topointer(L, -5);
+  shared = lua_topointer(L, -4);
+  weak = lua_topointer(L, -3);
+  mt = lua_topointer(L, -2);
+  payload = lua_topointer(L, -1);
+  lua_settop(L, 0);  // only the globals hold them now
+
+  snap = xlua_heap_snapshot(L);
+  CHECK(snap != NULL);
+  retainers = xlua_snapshot_retainers(snap, INT32_MAX);
+  CHECK(retainers != NULL);
+  CHECK(snapshot_view(snap, &view));
+
+  // chain: a -> b -> c
+  CHECK(retained(retainers, c) == object_bytes(&view, c));
+  CHECK(retained(retainers, b) == object_bytes(&view, b) + object_bytes(&view, c));
+  CHECK(retained(retainers, a) == object_bytes(&view, a) + object_bytes(&view, b) + object_bytes(&view, c));
+  // diamond: top -> left -> shared, top -> right -> shared, shared is dominated by top only
+  CHECK(retained(retainers, left) == object_bytes(&view, left));
+  CHECK(retained(retainers, right) == object_bytes(&view, right));
+  CHECK(retained(retainers, top) == object_bytes(&view, top) + object_bytes(&view, left) + object_bytes(&view, right)
+                                        + object_bytes(&view, shared));
+  // a weak value is not retained by its table
+  CHECK(find_edge(&view, weak, payload, 2) == NULL);
+  CHECK(retained(retainers, payload) == object_bytes(&view, payload));
+  CHECK(retained(retainers, weak) == object_bytes(&view, weak) + retained(retainers, mt));
+
+  xlua_snapshotdiff_free(retainers);
+  xlua_snapshot_free(snap);
+  return NULL;
+}
+
+static const char *test_edges(lua_State *L) {
+  HeapSnapshot *snap;
+  SnapshotView view;
+  const SnapshotEdge *edge;
+  const void *wrapped, *wrapped_co, *ud_meta, *ud_value, *co, *co_local;
+
+#if LUA_VERSION_NUM >= 504
+  lua_newuserdatauv(L, 8, 1);
+#else
+  lua_newuserdata(L, 8);
+#endif
+  lua_setglobal(L, "ud");
+  CHECK_LUA(L, "ud_meta, ud_value = {}, {}\n"
+               "debug.setmetatable(ud, ud_meta) debug.setuservalue(ud, ud_value)\n"
+               "wrapped = coroutine.wrap(function() coroutine.yield() end) wrapped()\n"
+               "wrapped_co = select(2, debug.getupvalue(wrapped, 1))\n"
+               "co = coroutine.create(function() local t = {} coroutine.yield(t) end)\n"
+               "co_local = select(2, coroutine.resume(co))");
+  wrapped = global_pointer(L, "wrapped");
+  wrapped_co = global_pointer(L, "wrapped_co");
+  ud_meta = global_pointer(L, "ud_meta");
+  ud_value = global_pointer(L, "ud_value");
+  co = global_pointer(L, "co");
+  co_local = global_pointer(L, "co_local");
+
+  snap = xlua_heap_snapshot(L);
+  CHECK(snap != NULL);
+  CHECK(snapshot_view(snap, &view));
+  // 6: upvalue of c closure, d is the index
+  edge = find_edge(&view, wrapped, wrapped_co, 6);
+  CHECK(edge != NULL && edge->d == 1);
+  // 7: metatable of userdata
+  CHECK(find_edge(&view, NULL, ud_meta, 7) != NULL);
+  // 8: uservalue of userdata, d is the index
+  edge = find_edge(&view, NULL, ud_value, 8);
+  CHECK(edge != NULL && edge->d == 1);
+  // 9: stack slot of a suspended thread
+  CHECK(find_edge(&view, co, co_local, 9) != NULL);
+
+  xlua_snapshot_free(snap);
+  return NULL;
+}
+
+typedef struct {
+  const char *name;
+  const char *(*run)(lua_State *L);
+} Case;
+
+static const Case cases[] = {
+    {"diff", test_diff},
+    {"load rejects", test_load_rejects},
+    {"retained", test_retained},
+    {"edges", test_edges},
+};
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+  int failed = 0;
+  size_t i;
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const Case *c = &cases[i];
+    lua_State *L;
+    const char *error;
+    if (filter != NULL && strstr(c->name, filter) == NULL) {
+      continue;
+    }
+    L = luaL_newstate();
+    luaL_openlibs(L);
+    // nothing may be collected between the snapshots of a case
+    lua_gc(L, LUA_GCSTOP, 0);
+    error = c->run(L);
+    if (error != NULL) {
+      printf("FAIL %s: %s\n", c->name, error);
+      failed++;
+    } else {
+      printf("ok   %s\n", c->name);
+    }
+    lua_close(L);
+  }
+  return failed == 0 ? 0 : 1;
+}
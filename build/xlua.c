@@ -14,9 +14,19 @@
 #include "lua.h"
 #include "lualib.h"
 
+#include <limits.h>
 #include <stdint.h>
 #include <string.h>
 #include "i64lib.h"
+#include "slab_alloc.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XLUA_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define XLUA_SIMD_NEON
+#include <arm_neon.h>
+#endif
 
 #if USING_LUAJIT
 #include "lj_obj.h"
@@ -161,12 +171,146 @@ LUA_API int xlua_tointeger(lua_State *L, int idx) { return (int)lua_tointeger(L,
 
 LUA_API void xlua_pushinteger(lua_State *L, int n) { lua_pushinteger(L, n); }
 
+/*
+** enums: pushed as plain Lua numbers, never boxed. 5.1/LuaJIT only fall back to an int64 userdata beyond 2^53, where a
+** double stops being exact. xlua_toenum accepts whatever xlua_pushenum can produce, in a single call from C#.
+*/
+
+#define ENUM_EXACT_MAX ((int64_t)1 << 53)
+
+LUA_API void xlua_pushenum(lua_State *L, int64_t n) {
+#if LUA_VERSION_NUM == 501
+  if (n >= -ENUM_EXACT_MAX && n <= ENUM_EXACT_MAX) {
+    lua_pushnumber(L, (lua_Number)n);
+  } else {
+    lua_pushint64(L, n);
+  }
+#else
+  lua_pushinteger(L, (lua_Integer)n);
+#endif
+}
+
+LUA_API int xlua_toenum(lua_State *L, int idx, int64_t *n) {
+#if LUA_VERSION_NUM == 501
+  if (lua_type(L, idx) == LUA_TNUMBER) {
+    lua_Number d = lua_tonumber(L, idx);
+    if (d < -(lua_Number)ENUM_EXACT_MAX || d > (lua_Number)ENUM_EXACT_MAX || d != (lua_Number)(int64_t)d) return 0;
+    *n = (int64_t)d;
+    return 1;
+  }
+  if (lua_isint64(L, idx) || lua_isuint64(L, idx)) {
+    *n = lua_toint64(L, idx);
+    return 1;
+  }
+  return 0;
+#else
+  if (!lua_isinteger(L, idx)) return 0;
+  *n = (int64_t)lua_tointeger(L, idx);
+  return 1;
+#endif
+}
+
 LUA_API void xlua_pushlstring(lua_State *L, const char *s, int len) { lua_pushlstring(L, s, len); }
 
+/*
+** string handles: a string C# pushes over and over (field, event, localisation key names) is registered once and
+** pushed back by its registry reference, with no encoding, hashing or copying. Registering the same bytes again gives
+** the same handle, handles live as long as the state, so they are for a bounded set of names, not arbitrary text
+*/
+static char string_handles_key;
+
+LUA_API int xlua_stringhandle(lua_State *L, const char *s, int len) {
+  int handle;
+  lua_pushlightuserdata(L, &string_handles_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  if (lua_type(L, -1) != LUA_TTABLE) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushlightuserdata(L, &string_handles_key);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+  }
+  lua_pushlstring(L, s, len);
+  lua_pushvalue(L, -1);
+  lua_rawget(L, -3);
+  if (lua_type(L, -1) == LUA_TNUMBER) {
+    handle = (int)lua_tointeger(L, -1);
+    lua_pop(L, 3);
+    return handle;
+  }
+  lua_pop(L, 1);
+  lua_pushvalue(L, -1);
+  handle = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_pushinteger(L, handle);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+  return handle;
+}
+
+LUA_API void xlua_pushstringhandle(lua_State *L, int handle) { lua_rawgeti(L, LUA_REGISTRYINDEX, handle); }
+
 LUALIB_API int xluaL_loadbuffer(lua_State *L, const char *buff, int size, const char *name) {
   return luaL_loadbuffer(L, buff, size, name);
 }
 
+#if LUA_VERSION_NUM >= 503
+#define rawlen(L, idx) ((int)lua_rawlen(L, idx))
+#define rawget_type(L, idx) lua_rawget(L, idx)
+#else
+#define rawlen(L, idx) ((int)lua_objlen(L, idx))
+static int rawget_type(lua_State *L, int idx) {
+  lua_rawget(L, idx);
+  return lua_type(L, -1);
+}
+#endif
+
+#if LUA_VERSION_NUM == 501
+#define push_globals(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#else
+#define push_globals(L) lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS)
+#endif
+
+/*
+** fast paths of the protected accessors below: a raw access does what lua_gettable/lua_settable would on a table
+** unless a metamethod can be reached, that is the key is absent and the table has a metatable, so those go without
+** lua_pcall (and without the C closure LuaJIT allocates for it)
+*/
+
+// the key on top is replaced by its value in the table at idx (absolute), returns 0 with the stack untouched if it can't
+static int try_rawget(lua_State *L, int idx) {
+  if (lua_type(L, idx) != LUA_TTABLE) {
+    return 0;
+  }
+  lua_pushvalue(L, -1);
+  if (rawget_type(L, idx) == LUA_TNIL && lua_getmetatable(L, idx)) {
+    lua_pop(L, 2);
+    return 0;
+  }
+  lua_replace(L, -2);
+  return 1;
+}
+
+// sets the key and value on top into the table at idx (absolute) and pops them, returns 0 with the stack untouched if it
+// can't: besides metamethods, lua_settable raises on a nil or NaN key, so that error is left to the protected call
+static int try_rawset(lua_State *L, int idx) {
+  int type = lua_type(L, -2);
+  if (lua_type(L, idx) != LUA_TTABLE || type == LUA_TNIL ||
+      (type == LUA_TNUMBER && lua_tonumber(L, -2) != lua_tonumber(L, -2))) {
+    return 0;
+  }
+  if (lua_getmetatable(L, idx)) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, -2);
+    type = rawget_type(L, idx);
+    lua_pop(L, 1);
+    if (type == LUA_TNIL) {
+      return 0;
+    }
+  }
+  lua_rawset(L, idx);
+  return 1;
+}
+
 static int c_lua_gettable(lua_State *L) {
   lua_gettable(L, 1);
   return 1;
@@ -175,6 +319,9 @@ static int c_lua_gettable(lua_State *L) {
 LUA_API int xlua_pgettable(lua_State *L, int idx) {
   int top = lua_gettop(L);
   idx = lua_absindex(L, idx);
+  if (try_rawget(L, idx)) {
+    return 0;
+  }
   lua_pushcfunction(L, c_lua_gettable);
   lua_pushvalue(L, idx);
   lua_pushvalue(L, top);
@@ -224,6 +371,9 @@ static int c_lua_settable(lua_State *L) {
 LUA_API int xlua_psettable(lua_State *L, int idx) {
   int top = lua_gettop(L);
   idx = lua_absindex(L, idx);
+  if (try_rawset(L, idx)) {
+    return 0;
+  }
   lua_pushcfunction(L, c_lua_settable);
   lua_pushvalue(L, idx);
   lua_pushvalue(L, top - 1);
@@ -271,12 +421,165 @@ LUA_API int xlua_psettable_bypath(lua_State *L, int idx, const char *path) {
   return lua_pcall(L, 3, 0, 0);
 }
 
+/*
+** compiled paths: the segments of a dotted path interned once into a registry anchored table (the path itself at [0]
+** for error messages), replayed with lua_rawget and no lua_pcall as long as a metamethod can not be involved, the
+** remaining steps go through lua_gettable/lua_settable under lua_pcall as the by-path functions above do
+*/
+LUA_API int xlua_compile_path(lua_State *L, const char *path) {
+  const char *pos = NULL;
+  int n = 0;
+  lua_newtable(L);
+  lua_pushstring(L, path);
+  lua_rawseti(L, -2, 0);
+  do {
+    pos = strchr(path, '.');
+    if (NULL == pos) {
+      lua_pushstring(L, path);
+    } else {
+      lua_pushlstring(L, path, pos - path);
+      path = pos + 1;
+    }
+    lua_rawseti(L, -2, ++n);
+  } while (pos);
+  return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+// walks segments 1 to last of the path table at segs from the value on top, pushing each value on the way; a raw lookup
+// gives what lua_gettable would unless the key is absent from a table with a metatable or the value is not a table,
+// there it stops; returns the first segment not walked
+static int walk_path_raw(lua_State *L, int segs, int last) {
+  int i, type = lua_type(L, -1);
+  for (i = 1; i <= last; i++) {
+    if (type != LUA_TTABLE) {
+      break;
+    }
+    lua_rawgeti(L, segs, i);
+    type = rawget_type(L, -2);
+    if (type == LUA_TNIL && lua_getmetatable(L, -2)) {
+      lua_pop(L, 2);
+      break;
+    }
+  }
+  return i;
+}
+
+static int c_lua_gettable_bypathref(lua_State *L) {
+  int i = (int)lua_tointeger(L, 3);
+  int n = rawlen(L, 2);
+  lua_pushvalue(L, 1);
+  for (; i <= n; i++) {
+    if (i > 1 && lua_type(L, -1) != LUA_TTABLE) {  // not found in path
+      lua_pushnil(L);
+      break;
+    }
+    lua_rawgeti(L, 2, i);
+    lua_gettable(L, -2);
+    lua_remove(L, -2);
+  }
+  return 1;
+}
+
+LUA_API int xlua_pgettable_bypathref(lua_State *L, int idx, int path_ref) {
+  int i, n, segs;
+  idx = lua_absindex(L, idx);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, path_ref);
+  segs = lua_gettop(L);
+  n = rawlen(L, segs);
+  lua_pushvalue(L, idx);
+  i = walk_path_raw(L, segs, n);
+  if (i <= n && (i == 1 || lua_type(L, -1) == LUA_TTABLE)) {
+    int ret;
+    if (lua_gettop(L) > segs + 1) {  // drop the values walked
+      lua_replace(L, segs + 1);
+      lua_settop(L, segs + 1);
+    }
+    lua_pushcfunction(L, c_lua_gettable_bypathref);
+    lua_insert(L, -2);
+    lua_pushvalue(L, segs);
+    lua_pushinteger(L, i);
+    ret = lua_pcall(L, 3, 1, 0);
+    lua_replace(L, segs);
+    return ret;
+  }
+  if (i <= n) {  // not found in path
+    lua_pushnil(L);
+  }
+  lua_replace(L, segs);
+  lua_settop(L, segs);
+  return 0;
+}
+
+static int c_lua_settable_bypathref(lua_State *L) {
+  int i = (int)lua_tointeger(L, 3);
+  int n = rawlen(L, 2);
+  lua_pushvalue(L, 1);
+  for (;; i++) {
+    if (i > 1 && lua_type(L, -1) != LUA_TTABLE) {
+      lua_rawgeti(L, 2, 0);
+      return luaL_error(L, "can not set value to %s", lua_tostring(L, -1));
+    }
+    if (i == n) {
+      break;
+    }
+    lua_rawgeti(L, 2, i);
+    lua_gettable(L, -2);
+    lua_remove(L, -2);
+  }
+  lua_rawgeti(L, 2, n);
+  lua_pushvalue(L, 4);
+  lua_settable(L, -3);
+  return 0;
+}
+
+LUA_API int xlua_psettable_bypathref(lua_State *L, int idx, int path_ref) {
+  int top = lua_gettop(L);
+  int i, n, ret;
+  idx = lua_absindex(L, idx);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, path_ref);
+  n = rawlen(L, top + 1);
+  lua_pushvalue(L, idx);
+  i = walk_path_raw(L, top + 1, n - 1);
+  if (i == n) {  // at the container of the last segment
+    if (lua_type(L, -1) == LUA_TTABLE) {
+      if (!lua_getmetatable(L, -1)) {
+        lua_rawgeti(L, top + 1, i);
+        lua_pushvalue(L, top);
+        lua_rawset(L, -3);
+        lua_settop(L, top - 1);
+        return 0;
+      }
+      lua_pop(L, 1);
+    }
+  }
+  if (lua_gettop(L) > top + 2) {
+    lua_replace(L, top + 2);
+    lua_settop(L, top + 2);
+  }
+  lua_pushcfunction(L, c_lua_settable_bypathref);
+  lua_insert(L, -2);
+  lua_pushvalue(L, top + 1);
+  lua_pushinteger(L, i);
+  lua_pushvalue(L, top);
+  ret = lua_pcall(L, 4, 0, 0);
+  lua_remove(L, top + 1);
+  lua_remove(L, top);
+  return ret;
+}
+
 static int c_lua_getglobal(lua_State *L) {
   lua_getglobal(L, lua_tostring(L, 1));
   return 1;
 }
 
 LUA_API int xlua_getglobal(lua_State *L, const char *name) {
+  push_globals(L);
+  lua_pushstring(L, name);
+  if (rawget_type(L, -2) != LUA_TNIL || !lua_getmetatable(L, -2)) {
+    lua_remove(L, -2);
+    return 0;
+  }
+  lua_pop(L, 3);
   lua_pushcfunction(L, c_lua_getglobal);
   lua_pushstring(L, name);
   return lua_pcall(L, 1, 1, 0);
@@ -289,6 +592,22 @@ static int c_lua_setglobal(lua_State *L) {
 
 LUA_API int xlua_setglobal(lua_State *L, const char *name) {
   int top = lua_gettop(L);
+  push_globals(L);
+  if (!lua_getmetatable(L, top + 1)) {
+    lua_pushstring(L, name);
+    lua_pushvalue(L, top);
+    lua_rawset(L, top + 1);
+    lua_settop(L, top - 1);
+    return 0;
+  }
+  lua_pop(L, 1);
+  lua_pushstring(L, name);
+  lua_pushvalue(L, top);
+  if (try_rawset(L, top + 1)) {
+    lua_settop(L, top - 1);
+    return 0;
+  }
+  lua_settop(L, top);
   lua_pushcfunction(L, c_lua_setglobal);
   lua_pushstring(L, name);
   lua_pushvalue(L, top);
@@ -317,6 +636,7 @@ static void cacheud(lua_State *L, int key, int cache_ref) {
 LUA_API void xlua_pushcsobj(lua_State *L, int key, int meta_ref, int need_cache, int cache_ref) {
   int *pointer = (int *)lua_newuserdata(L, sizeof(int));
   *pointer = key;
+  xlua_memstats_udata(L, pointer, MEM_CSOBJ);
 
   if (need_cache) cacheud(L, key, cache_ref);
 
@@ -325,33 +645,454 @@ LUA_API void xlua_pushcsobj(lua_State *L, int key, int meta_ref, int need_cache,
   lua_setmetatable(L, -2);
 }
 
-void print_top(lua_State *L) {
-  lua_getglobal(L, "print");
-  lua_pushvalue(L, -2);
-  lua_call(L, 1, 0);
-}
+/*
+** C# object handles: one slot per ObjectPool index holding the generation of the newest userdata pushed for it. The
+** userdata carries {index, generation}, so a __gc that runs after its index has been recycled (Lua clears weak values
+** before calling finalizers, and C# may free and reuse the index in between) is recognised as stale and ignored.
+** The public API cannot push a full userdata from its address, so cached userdata still sit in a weak array, but the
+** slot decides hit or miss with one load before that array is touched.
+*/
+
+typedef struct {
+  int key;  // must stay first, xlua_tocsobj_safe/xlua_tocsobj_fast read it as an int
+  uint32_t gen;
+} CSObjUdata;
+
+typedef struct {
+  uint32_t gen;
+  int live;  // the userdata of generation gen is neither finalized nor known to be gone from the cache
+} CSObjSlot;
+
+typedef struct {
+  int cache_ref;  // weak-valued table, index -> userdata
+  int slots_ref;  // userdata block backing slots, replaced when it grows
+  int size;
+  CSObjSlot *slots;
+} CSObjHandles;
+
+// creates the handle table of a lua_State; it is anchored in the registry and freed by lua_close
+LUA_API void *xlua_new_csobj_handles(lua_State *L) {
+  CSObjHandles *h = (CSObjHandles *)lua_newuserdata(L, sizeof(CSObjHandles));
+  h->slots_ref = LUA_NOREF;
+  h->size = 0;
+  h->slots = NULL;
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_pushstring(L, "__mode");
+  lua_pushstring(L, "v");
+  lua_rawset(L, -3);
+  lua_setmetatable(L, -2);
+  h->cache_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  luaL_ref(L, LUA_REGISTRYINDEX);
+  return h;
+}
+
+static void grow_csobj_slots(lua_State *L, CSObjHandles *h, int key) {
+  int size = h->size > 0 ? h->size : 512;
+  CSObjSlot *slots;
+  while (size <= key) size *= 2;
+  slots = (CSObjSlot *)lua_newuserdata(L, size * sizeof(CSObjSlot));
+  if (h->size > 0) memcpy(slots, h->slots, h->size * sizeof(CSObjSlot));
+  memset(slots + h->size, 0, (size - h->size) * sizeof(CSObjSlot));
+  if (h->slots_ref == LUA_NOREF) {
+    h->slots_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  } else {
+    lua_rawseti(L, LUA_REGISTRYINDEX, h->slots_ref);
+  }
+  h->slots = slots;
+  h->size = size;
+}
+
+// pushes the cached userdata of key and returns 1, or returns 0 if there is none. A slot whose userdata was collected
+// but not yet finalized is detached here: its pending __gc will be ignored, so C# may free key right away.
+LUA_API int xlua_tryget_csobj(lua_State *L, void *handles, int key) {
+  CSObjHandles *h = (CSObjHandles *)handles;
+  if (key < 0 || key >= h->size || !h->slots[key].live) return 0;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, h->cache_ref);
+  lua_rawgeti(L, -1, key);
+  if (!lua_isnil(L, -1)) {
+    lua_remove(L, -2);
+    return 1;
+  }
+  lua_pop(L, 2);
+  h->slots[key].live = 0;
+  return 0;
+}
+
+LUA_API void xlua_pushcsobj_handle(lua_State *L, void *handles, int key, int meta_ref, int need_cache) {
+  CSObjHandles *h = (CSObjHandles *)handles;
+  CSObjUdata *ud;
+  if (key >= h->size) grow_csobj_slots(L, h, key);
+  ud = (CSObjUdata *)lua_newuserdata(L, sizeof(CSObjUdata));
+  ud->key = key;
+  ud->gen = ++h->slots[key].gen;
+  h->slots[key].live = 1;
+  xlua_memstats_udata(L, ud, MEM_CSOBJ);
+
+  if (need_cache) cacheud(L, key, h->cache_ref);
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, meta_ref);
+
+  lua_setmetatable(L, -2);
+}
+
+// for __gc: returns the index of the C# object at idx if this userdata still owns it, -1 if it is not a C# object or
+// its index was already released or recycled
+LUA_API int xlua_release_csobj(lua_State *L, void *handles, int idx) {
+  CSObjHandles *h = (CSObjHandles *)handles;
+  CSObjUdata *ud;
+  int key = xlua_tocsobj_safe(L, idx);
+  if (key == -1) return -1;
+  if (rawlen(L, idx) < (int)sizeof(CSObjUdata)) return key;  // pushed by xlua_pushcsobj, no generation
+  ud = (CSObjUdata *)lua_touserdata(L, idx);
+  if (key < 0 || key >= h->size || !h->slots[key].live || h->slots[key].gen != ud->gen) return -1;
+  h->slots[key].live = 0;
+  return key;
+}
+
+void print_top(lua_State *L) {
+  lua_getglobal(L, "print");
+  lua_pushvalue(L, -2);
+  lua_call(L, 1, 0);
+}
+
+void print_str(lua_State *L, char *str) {
+  lua_getglobal(L, "print");
+  lua_pushstring(L, str);
+  lua_call(L, 1, 0);
+}
+
+void print_value(lua_State *L, char *str, int idx) {
+  idx = lua_absindex(L, idx);
+  lua_getglobal(L, "print");
+  lua_pushstring(L, str);
+  lua_pushvalue(L, idx);
+  lua_call(L, 2, 0);
+}
+
+/*
+** inline member cache for obj_indexer / cls_indexer
+**
+** String keys are matched by the address of their interned bytes. The key is anchored by the cache, so the address
+** can not be reused while the slot is alive. A slot remembers which member table answered the key (own or inherited)
+** and the member kind, a hit costs one array load plus one raw probe of that table.
+*/
+#define INDEXER_CACHE_SIZE 32
+#define INDEXER_CACHE_WAYS 4
+
+#define IC_NONE 0
+#define IC_METHOD 1
+#define IC_GETTER 2
+#define IC_FIELD 3
+
+typedef struct {
+  unsigned int epoch;
+  unsigned int victim;
+  const char *keys[INDEXER_CACHE_SIZE];
+  unsigned char kinds[INDEXER_CACHE_SIZE];
+} IndexerCache;
+
+static unsigned int indexer_cache_epoch = 0;
+static uint64_t indexer_cache_hits = 0;
+static uint64_t indexer_cache_misses = 0;
+
+// member tables changed after registration (e.g. private_accessible), drop every cached slot
+LUA_API void xlua_indexer_cache_invalidate() { indexer_cache_epoch++; }
+
+LUA_API void xlua_indexer_cache_stats(uint64_t *hits, uint64_t *misses, int reset) {
+  *hits = indexer_cache_hits;
+  *misses = indexer_cache_misses;
+  if (reset) {
+    indexer_cache_hits = 0;
+    indexer_cache_misses = 0;
+  }
+}
+
+// first slot of the group the key may live in, a key is looked up in INDEXER_CACHE_WAYS consecutive slots
+static unsigned int indexer_cache_slot(const char *key) {
+  uint32_t h = (uint32_t)((uintptr_t)key >> 3);
+  h *= 2654435761u;
+  return (unsigned int)(h >> 27) & (INDEXER_CACHE_SIZE - INDEXER_CACHE_WAYS);
+}
+
+// key at index 2, pushes the member on hit
+static int indexer_cache_get(lua_State *L, int cache_idx, int anchors_idx) {
+  IndexerCache *cache = (IndexerCache *)lua_touserdata(L, cache_idx);
+  const char *key = lua_tostring(L, 2);
+  unsigned int slot = indexer_cache_slot(key);
+  unsigned int end = slot + INDEXER_CACHE_WAYS;
+
+  if (cache == NULL) {
+    indexer_cache_misses++;
+    return IC_NONE;
+  }
+  if (cache->epoch != indexer_cache_epoch) {
+    memset(cache->keys, 0, sizeof(cache->keys));
+    cache->epoch = indexer_cache_epoch;
+  }
+  while (slot < end && cache->keys[slot] != key) {
+    slot++;
+  }
+  if (slot == end) {
+    indexer_cache_misses++;
+    return IC_NONE;
+  }
+  lua_rawgeti(L, anchors_idx, slot + 1);  // member table
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+  lua_remove(L, -2);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    cache->keys[slot] = NULL;
+    indexer_cache_misses++;
+    return IC_NONE;
+  }
+  indexer_cache_hits++;
+  return cache->kinds[slot];
+}
+
+// key at index 2, member table at table_idx
+static void indexer_cache_set(lua_State *L, int cache_idx, int anchors_idx, int table_idx, int kind) {
+  IndexerCache *cache = (IndexerCache *)lua_touserdata(L, cache_idx);
+  const char *key = lua_tostring(L, 2);
+  unsigned int first = indexer_cache_slot(key);
+  unsigned int slot;
+
+  table_idx = lua_absindex(L, table_idx);
+  if (cache == NULL) {
+    cache = (IndexerCache *)lua_newuserdata(L, sizeof(IndexerCache));
+    memset(cache, 0, sizeof(IndexerCache));
+    cache->epoch = indexer_cache_epoch;
+    lua_replace(L, cache_idx);
+    lua_createtable(L, INDEXER_CACHE_SIZE * 2, 0);
+    lua_replace(L, anchors_idx);
+  }
+  for (slot = first; slot < first + INDEXER_CACHE_WAYS; slot++) {
+    if (cache->keys[slot] == NULL || cache->keys[slot] == key) {
+      break;
+    }
+  }
+  if (slot == first + INDEXER_CACHE_WAYS) {  // group is full, evict round robin
+    slot = first + (cache->victim++ & (INDEXER_CACHE_WAYS - 1));
+  }
+  lua_pushvalue(L, table_idx);
+  lua_rawseti(L, anchors_idx, slot + 1);
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, anchors_idx, INDEXER_CACHE_SIZE + slot + 1);
+  cache->keys[slot] = key;
+  cache->kinds[slot] = (unsigned char)kind;
+}
+
+// pushes upvalue[baseindex] of an indexer closure, resolving it from upvalue[base] the same way the indexer does
+static void indexer_push_base(lua_State *L, int func, int base_n, int funcs_n, int baseindex_n) {
+  lua_getupvalue(L, func, base_n);
+  if (!lua_isnil(L, -1)) {
+    lua_getupvalue(L, func, funcs_n);
+    lua_insert(L, -2);
+    while (!lua_isnil(L, -1)) {
+      lua_pushvalue(L, -1);
+      lua_gettable(L, -3);
+      if (!lua_isnil(L, -1))  // found
+      {
+        lua_setupvalue(L, func, baseindex_n);  // baseindex = indexfuncs[base]
+        break;
+      }
+      lua_pop(L, 1);
+      lua_getfield(L, -1, "BaseType");
+      lua_remove(L, -2);
+    }
+    lua_pop(L, 2);
+    lua_pushnil(L);
+    lua_setupvalue(L, func, base_n);  // base = nil
+  } else {
+    lua_pop(L, 1);
+  }
+  lua_getupvalue(L, func, baseindex_n);
+}
+
+// probes upvalue[n] of func (a member table) for the key at index 2, leaves the table on stack when found
+static int indexer_probe_upvalue(lua_State *L, int func, int n) {
+  if (lua_getupvalue(L, func, n) == NULL) {
+    return 0;
+  }
+  if (lua_istable(L, -1)) {
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    if (!lua_isnil(L, -1)) {
+      lua_pop(L, 1);
+      return 1;
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  return 0;
+}
+
+LUA_API int obj_indexer(lua_State *L);
+
+// looks for the key at index 2 in an obj_indexer closure and its bases, leaves the member table on stack when found
+static int obj_indexer_find(lua_State *L, int func, int depth) {
+  int kind = IC_NONE;
+  if (depth > 64 || lua_tocfunction(L, func) != obj_indexer) {
+    return IC_NONE;
+  }
+  if (indexer_probe_upvalue(L, func, 1)) {
+    return IC_METHOD;
+  }
+  if (indexer_probe_upvalue(L, func, 2)) {
+    return IC_GETTER;
+  }
+  // a string indexer answers before the base does
+  lua_getupvalue(L, func, 3);
+  if (!lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    return IC_NONE;
+  }
+  lua_pop(L, 1);
+  indexer_push_base(L, func, 4, 5, 7);
+  kind = obj_indexer_find(L, lua_gettop(L), depth + 1);
+  lua_remove(L, kind == IC_NONE ? -1 : -2);
+  return kind;
+}
+
+/*
+** flattened inheritance
+**
+** When enabled, the first lookup that misses the own tables of an indexer merges the (already flattened) member tables
+** of its base into its own, so inherited members are found in one probe however deep the hierarchy is. Members shadowed
+** by the derived type are left alone, and a level with a string indexer is not merged into, because that indexer must
+** answer before any inherited member. Lazy reflection stubs patch the table of their declaring type on first call, so
+** they are not copied, the base chain still finds them.
+*/
+static int flatten_indexers = 0;
+
+LUA_API void xlua_set_flatten_indexers(int enable) { flatten_indexers = enable; }
+
+static int csharp_function_wrap(lua_State *L);
+
+static int is_lazy_csharp_function(lua_State *L, int idx) {
+  if (lua_tocfunction(L, idx) != csharp_function_wrap || lua_getupvalue(L, idx, 3) == NULL) {
+    return 0;
+  }
+  lua_pop(L, 1);
+  return 1;
+}
+
+// pushes the running C function
+static void push_running_function(lua_State *L) {
+  lua_Debug ar;
+  lua_getstack(L, 0, &ar);
+  lua_getinfo(L, "f", &ar);
+}
+
+// copies members of the table at src into upvalue[dst_n] of func, skipping keys already in upvalue[dst_n] or
+// upvalue[other_n] (0 for none)
+static void indexer_merge_members(lua_State *L, int func, int dst_n, int other_n, int src) {
+  int dst, other;
+  src = lua_absindex(L, src);
+  if (!lua_istable(L, src)) {
+    return;
+  }
+  lua_getupvalue(L, func, dst_n);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setupvalue(L, func, dst_n);
+  }
+  dst = lua_gettop(L);
+  if (other_n == 0 || lua_getupvalue(L, func, other_n) == NULL) {
+    lua_pushnil(L);
+  }
+  other = lua_gettop(L);
+
+  lua_pushnil(L);
+  while (lua_next(L, src) != 0) {
+    if (lua_type(L, -2) == LUA_TSTRING && !is_lazy_csharp_function(L, -1)) {
+      lua_pushvalue(L, -2);
+      lua_rawget(L, dst);
+      if (lua_isnil(L, -1) && lua_istable(L, other)) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -2);
+        lua_rawget(L, other);
+      }
+      if (lua_isnil(L, -1)) {
+        lua_pushvalue(L, -3);
+        lua_pushvalue(L, -3);
+        lua_rawset(L, dst);
+      }
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 2);
+}
+
+// upvalue[10] of obj_indexer marks it flattened
+static void obj_indexer_flatten(lua_State *L, int func, int depth) {
+  int base;
+  if (depth > 64 || lua_tocfunction(L, func) != obj_indexer) {
+    return;
+  }
+  lua_getupvalue(L, func, 10);
+  if (lua_toboolean(L, -1)) {
+    lua_pop(L, 1);
+    return;
+  }
+  lua_pop(L, 1);
+  lua_pushboolean(L, 1);
+  lua_setupvalue(L, func, 10);
 
-void print_str(lua_State *L, char *str) {
-  lua_getglobal(L, "print");
-  lua_pushstring(L, str);
-  lua_call(L, 1, 0);
+  lua_getupvalue(L, func, 3);
+  if (!lua_isnil(L, -1)) {  // has csindexer
+    lua_pop(L, 1);
+    return;
+  }
+  lua_pop(L, 1);
+
+  indexer_push_base(L, func, 4, 5, 7);
+  base = lua_gettop(L);
+  if (lua_tocfunction(L, base) == obj_indexer) {
+    obj_indexer_flatten(L, base, depth + 1);
+    lua_getupvalue(L, base, 1);
+    indexer_merge_members(L, func, 1, 2, -1);
+    lua_pop(L, 1);
+    lua_getupvalue(L, base, 2);
+    indexer_merge_members(L, func, 2, 1, -1);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
 }
 
-void print_value(lua_State *L, char *str, int idx) {
-  idx = lua_absindex(L, idx);
-  lua_getglobal(L, "print");
-  lua_pushstring(L, str);
-  lua_pushvalue(L, idx);
-  lua_call(L, 2, 0);
+static int obj_indexer_member(lua_State *L, int kind) {
+  if (kind == IC_GETTER) {
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 1);
+  }
+  return 1;
 }
 
-// upvalue --- [1]: methods, [2]:getters, [3]:csindexer, [4]:base, [5]:indexfuncs, [6]:arrayindexer, [7]:baseindex
+// upvalue --- [1]: methods, [2]:getters, [3]:csindexer, [4]:base, [5]:indexfuncs, [6]:arrayindexer, [7]:baseindex,
+//             [8]:membercache, [9]:membercache anchors, [10]:flattened
 // param   --- [1]: obj, [2]: key
 LUA_API int obj_indexer(lua_State *L) {
+  int is_str_key = lua_type(L, 2) == LUA_TSTRING;
+  int kind;
+
+  if (is_str_key) {
+    kind = indexer_cache_get(L, lua_upvalueindex(8), lua_upvalueindex(9));
+    if (kind != IC_NONE) {
+      return obj_indexer_member(L, kind);
+    }
+  }
+
   if (!lua_isnil(L, lua_upvalueindex(1))) {
     lua_pushvalue(L, 2);
     lua_gettable(L, lua_upvalueindex(1));
     if (!lua_isnil(L, -1)) {  // has method
+      if (is_str_key) {
+        indexer_cache_set(L, lua_upvalueindex(8), lua_upvalueindex(9), lua_upvalueindex(1), IC_METHOD);
+      }
       return 1;
     }
     lua_pop(L, 1);
@@ -361,6 +1102,9 @@ LUA_API int obj_indexer(lua_State *L) {
     lua_pushvalue(L, 2);
     lua_gettable(L, lua_upvalueindex(2));
     if (!lua_isnil(L, -1)) {  // has getter
+      if (is_str_key) {
+        indexer_cache_set(L, lua_upvalueindex(8), lua_upvalueindex(9), lua_upvalueindex(2), IC_GETTER);
+      }
       lua_pushvalue(L, 1);
       lua_call(L, 1, 1);
       return 1;
@@ -387,6 +1131,12 @@ LUA_API int obj_indexer(lua_State *L) {
     lua_pop(L, 2);
   }
 
+  if (flatten_indexers && !lua_toboolean(L, lua_upvalueindex(10))) {
+    push_running_function(L);
+    obj_indexer_flatten(L, lua_gettop(L), 0);
+    lua_pop(L, 1);
+  }
+
   if (!lua_isnil(L, lua_upvalueindex(4))) {
     lua_pushvalue(L, lua_upvalueindex(4));
     while (!lua_isnil(L, -1)) {
@@ -407,6 +1157,17 @@ LUA_API int obj_indexer(lua_State *L) {
   }
 
   if (!lua_isnil(L, lua_upvalueindex(7))) {
+    if (is_str_key && lua_isnil(L, lua_upvalueindex(3))) {
+      lua_pushvalue(L, lua_upvalueindex(7));
+      kind = obj_indexer_find(L, lua_gettop(L), 0);
+      if (kind != IC_NONE) {  // inherited member, remember the table it lives in
+        indexer_cache_set(L, lua_upvalueindex(8), lua_upvalueindex(9), -1, kind);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        return obj_indexer_member(L, kind);
+      }
+      lua_pop(L, 1);
+    }
     lua_settop(L, 2);
     lua_pushvalue(L, lua_upvalueindex(7));
     lua_insert(L, 1);
@@ -419,11 +1180,50 @@ LUA_API int obj_indexer(lua_State *L) {
 
 LUA_API int gen_obj_indexer(lua_State *L) {
   lua_pushnil(L);
-  lua_pushcclosure(L, obj_indexer, 7);
+  lua_pushnil(L);
+  lua_pushnil(L);
+  lua_pushboolean(L, 0);
+  lua_pushcclosure(L, obj_indexer, 10);
   return 0;
 }
 
-// upvalue --- [1]:setters, [2]:csnewindexer, [3]:base, [4]:newindexfuncs, [5]:arrayindexer, [6]:basenewindex
+LUA_API int obj_newindexer(lua_State *L);
+
+// upvalue[7] of obj_newindexer marks it flattened
+static void obj_newindexer_flatten(lua_State *L, int func, int depth) {
+  int base;
+  if (depth > 64 || lua_tocfunction(L, func) != obj_newindexer) {
+    return;
+  }
+  lua_getupvalue(L, func, 7);
+  if (lua_toboolean(L, -1)) {
+    lua_pop(L, 1);
+    return;
+  }
+  lua_pop(L, 1);
+  lua_pushboolean(L, 1);
+  lua_setupvalue(L, func, 7);
+
+  lua_getupvalue(L, func, 2);
+  if (!lua_isnil(L, -1)) {  // has csnewindexer
+    lua_pop(L, 1);
+    return;
+  }
+  lua_pop(L, 1);
+
+  indexer_push_base(L, func, 3, 4, 6);
+  base = lua_gettop(L);
+  if (lua_tocfunction(L, base) == obj_newindexer) {
+    obj_newindexer_flatten(L, base, depth + 1);
+    lua_getupvalue(L, base, 1);
+    indexer_merge_members(L, func, 1, 0, -1);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+// upvalue --- [1]:setters, [2]:csnewindexer, [3]:base, [4]:newindexfuncs, [5]:arrayindexer, [6]:basenewindex,
+//             [7]:flattened
 // param   --- [1]: obj, [2]: key, [3]: value
 LUA_API int obj_newindexer(lua_State *L) {
   if (!lua_isnil(L, lua_upvalueindex(1))) {
@@ -458,6 +1258,12 @@ LUA_API int obj_newindexer(lua_State *L) {
     return 0;
   }
 
+  if (flatten_indexers && !lua_toboolean(L, lua_upvalueindex(7))) {
+    push_running_function(L);
+    obj_newindexer_flatten(L, lua_gettop(L), 0);
+    lua_pop(L, 1);
+  }
+
   if (!lua_isnil(L, lua_upvalueindex(3))) {
     lua_pushvalue(L, lua_upvalueindex(3));
     while (!lua_isnil(L, -1)) {
@@ -491,17 +1297,59 @@ LUA_API int obj_newindexer(lua_State *L) {
 
 LUA_API int gen_obj_newindexer(lua_State *L) {
   lua_pushnil(L);
-  lua_pushcclosure(L, obj_newindexer, 6);
+  lua_pushboolean(L, 0);
+  lua_pushcclosure(L, obj_newindexer, 7);
   return 0;
 }
 
-// upvalue --- [1]:getters, [2]:feilds, [3]:base, [4]:indexfuncs, [5]:baseindex
+LUA_API int cls_indexer(lua_State *L);
+
+// looks for the key at index 2 in a cls_indexer closure and its bases, leaves the member table on stack when found
+static int cls_indexer_find(lua_State *L, int func, int depth) {
+  int kind = IC_NONE;
+  if (depth > 64 || lua_tocfunction(L, func) != cls_indexer) {
+    return IC_NONE;
+  }
+  if (indexer_probe_upvalue(L, func, 1)) {
+    return IC_GETTER;
+  }
+  if (indexer_probe_upvalue(L, func, 2)) {
+    return IC_FIELD;
+  }
+  indexer_push_base(L, func, 3, 4, 5);
+  kind = cls_indexer_find(L, lua_gettop(L), depth + 1);
+  lua_remove(L, kind == IC_NONE ? -1 : -2);
+  return kind;
+}
+
+static int cls_indexer_member(lua_State *L, int kind) {
+  if (kind == IC_GETTER) {
+    lua_call(L, 0, 1);
+  }
+  return 1;
+}
+
+// upvalue --- [1]:getters, [2]:feilds, [3]:base, [4]:indexfuncs, [5]:baseindex, [6]:membercache,
+//             [7]:membercache anchors
 // param   --- [1]: obj, [2]: key
 LUA_API int cls_indexer(lua_State *L) {
+  int is_str_key = lua_type(L, 2) == LUA_TSTRING;
+  int kind;
+
+  if (is_str_key) {
+    kind = indexer_cache_get(L, lua_upvalueindex(6), lua_upvalueindex(7));
+    if (kind != IC_NONE) {
+      return cls_indexer_member(L, kind);
+    }
+  }
+
   if (!lua_isnil(L, lua_upvalueindex(1))) {
     lua_pushvalue(L, 2);
     lua_gettable(L, lua_upvalueindex(1));
     if (!lua_isnil(L, -1)) {  // has getter
+      if (is_str_key) {
+        indexer_cache_set(L, lua_upvalueindex(6), lua_upvalueindex(7), lua_upvalueindex(1), IC_GETTER);
+      }
       lua_call(L, 0, 1);
       return 1;
     }
@@ -512,6 +1360,9 @@ LUA_API int cls_indexer(lua_State *L) {
     lua_pushvalue(L, 2);
     lua_rawget(L, lua_upvalueindex(2));
     if (!lua_isnil(L, -1)) {  // has feild
+      if (is_str_key) {
+        indexer_cache_set(L, lua_upvalueindex(6), lua_upvalueindex(7), lua_upvalueindex(2), IC_FIELD);
+      }
       return 1;
     }
     lua_pop(L, 1);
@@ -537,6 +1388,17 @@ LUA_API int cls_indexer(lua_State *L) {
   }
 
   if (!lua_isnil(L, lua_upvalueindex(5))) {
+    if (is_str_key) {
+      lua_pushvalue(L, lua_upvalueindex(5));
+      kind = cls_indexer_find(L, lua_gettop(L), 0);
+      if (kind != IC_NONE) {  // inherited member, remember the table it lives in
+        indexer_cache_set(L, lua_upvalueindex(6), lua_upvalueindex(7), -1, kind);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        return cls_indexer_member(L, kind);
+      }
+      lua_pop(L, 1);
+    }
     lua_settop(L, 2);
     lua_pushvalue(L, lua_upvalueindex(5));
     lua_insert(L, 1);
@@ -550,7 +1412,9 @@ LUA_API int cls_indexer(lua_State *L) {
 
 LUA_API int gen_cls_indexer(lua_State *L) {
   lua_pushnil(L);
-  lua_pushcclosure(L, cls_indexer, 5);
+  lua_pushnil(L);
+  lua_pushnil(L);
+  lua_pushcclosure(L, cls_indexer, 7);
   return 0;
 }
 
@@ -700,7 +1564,7 @@ static int csharp_function_wrap(lua_State *L) {
     return lua_error(L);
   }
 
-  if (lua_gethook(L)) {
+  if (lua_gethook(L) == hook) {
     call_ret_hook(L);
   }
 
@@ -727,34 +1591,54 @@ LUA_API void xlua_set_csharp_wrapper_caller(lua_CSWrapperCaller wrapper_caller)
   g_csharp_wrapper_caller = wrapper_caller;
 }
 
-static int csharp_function_wrapper_wrapper(lua_State *L) {
-  int ret = 0;
-
-  if (g_csharp_wrapper_caller == NULL) {
-    return luaL_error(L, "g_csharp_wrapper_caller not set");
-  }
-
-  ret = g_csharp_wrapper_caller(L, xlua_tointeger(L, lua_upvalueindex(1)), lua_gettop(L));
-
+// what every C# wrapper closure does after the call: raise the error C# flagged in upvalue 2, then the profiler hook
+static int csharp_wrapper_return(lua_State *L, int ret) {
   if (lua_toboolean(L, lua_upvalueindex(2))) {
     lua_pushboolean(L, 0);
     lua_replace(L, lua_upvalueindex(2));
     return lua_error(L);
   }
 
-  if (lua_gethook(L)) {
+  if (lua_gethook(L) == hook) {
     call_ret_hook(L);
   }
 
   return ret;
 }
 
+static int csharp_function_wrapper_wrapper(lua_State *L) {
+  if (g_csharp_wrapper_caller == NULL) {
+    return luaL_error(L, "g_csharp_wrapper_caller not set");
+  }
+
+  return csharp_wrapper_return(L, g_csharp_wrapper_caller(L, xlua_tointeger(L, lua_upvalueindex(1)), lua_gettop(L)));
+}
+
 LUA_API void xlua_push_csharp_wrapper(lua_State *L, int wrapperid) {
   lua_pushinteger(L, wrapperid);
   lua_pushboolean(L, 0);
   lua_pushcclosure(L, csharp_function_wrapper_wrapper, 2);
 }
 
+/*
+** direct wrappers: the closure keeps the wrapper's own function pointer in upvalue 1 instead of a wrapper id, so a call
+** jumps straight into it, without g_csharp_wrapper_caller and the C# side state/id lookup. Upvalue 2 is the same error
+** flag, so xlua_upvalueindex and xlua_csharp_str_error work unchanged.
+*/
+
+typedef int (*lua_CSWrapper)(lua_State *L, int top);
+
+static int csharp_wrapper_direct(lua_State *L) {
+  lua_CSWrapper fn = (lua_CSWrapper)lua_touserdata(L, lua_upvalueindex(1));
+  return csharp_wrapper_return(L, fn(L, lua_gettop(L)));
+}
+
+LUA_API void xlua_push_csharp_wrapper_direct(lua_State *L, lua_CSWrapper fn) {
+  lua_pushlightuserdata(L, (void *)fn);
+  lua_pushboolean(L, 0);
+  lua_pushcclosure(L, csharp_wrapper_direct, 2);
+}
+
 LUALIB_API int xlua_upvalueindex(int n) { return lua_upvalueindex(2 + n); }
 
 LUALIB_API int xlua_csharp_str_error(lua_State *L, const char *msg) {
@@ -780,6 +1664,7 @@ LUA_API void *xlua_pushstruct(lua_State *L, unsigned int size, int meta_ref) {
   CSharpStruct *css = (CSharpStruct *)lua_newuserdata(L, size + sizeof(int) + sizeof(unsigned int));
   css->fake_id = -1;
   css->len = size;
+  xlua_memstats_udata(L, css, MEM_STRUCT);
   lua_rawgeti(L, LUA_REGISTRYINDEX, meta_ref);
   lua_setmetatable(L, -2);
   return css;
@@ -795,6 +1680,7 @@ LUA_API void *xlua_newstruct(lua_State *L, int size, int meta_ref) {
   CSharpStruct *css = (CSharpStruct *)lua_newuserdata(L, size + sizeof(int) + sizeof(unsigned int));
   css->fake_id = -1;
   css->len = size;
+  xlua_memstats_udata(L, css, MEM_STRUCT);
   lua_rawgeti(L, LUA_REGISTRYINDEX, meta_ref);
   lua_setmetatable(L, -2);
   return css->data;
@@ -1034,6 +1920,199 @@ LUALIB_API int xlua_unpack_decimal(void *p, int offset, uint8_t *scale, uint8_t
   }
 }
 
+/*
+** batched float vector transfer: an array of count vectors (components floats each, stride bytes apart, e.g. a pinned
+** Vector3[]/Quaternion[]/Color[]) moved between native memory and lua in one call instead of one pack/unpack per
+** element. Either as a table of CSharpStruct userdata, or as a flat table of numbers {x1, y1, z1, x2, ...}.
+*/
+#define VECTOR_MAX_COMPONENTS 6
+#define VECTOR_CHUNK 64
+
+static int vector_args_ok(int count, int components, int stride) {
+  return count >= 0 && components >= 1 && components <= VECTOR_MAX_COMPONENTS &&
+         stride >= components * (int)sizeof(float);
+}
+
+static void vector_copy(float *dst, const float *src, int components) {
+#if defined(XLUA_SIMD_SSE2)
+  if (components == 4) {
+    _mm_storeu_ps(dst, _mm_loadu_ps(src));
+    return;
+  }
+#elif defined(XLUA_SIMD_NEON)
+  if (components == 4) {
+    vst1q_f32(dst, vld1q_f32(src));
+    return;
+  }
+#endif
+  memcpy(dst, src, components * sizeof(float));
+}
+
+static void float_to_number(lua_Number *dst, const float *src, int n) {
+  int i = 0;
+#if defined(XLUA_SIMD_SSE2) || defined(XLUA_SIMD_NEON)
+  if (sizeof(lua_Number) == sizeof(double)) {
+    double *d = (double *)dst;
+    for (; i + 4 <= n; i += 4) {
+#if defined(XLUA_SIMD_SSE2)
+      __m128 f = _mm_loadu_ps(src + i);
+      _mm_storeu_pd(d + i, _mm_cvtps_pd(f));
+      _mm_storeu_pd(d + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+#else
+      float32x4_t f = vld1q_f32(src + i);
+      vst1q_f64(d + i, vcvt_f64_f32(vget_low_f32(f)));
+      vst1q_f64(d + i + 2, vcvt_high_f64_f32(f));
+#endif
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (lua_Number)src[i];
+  }
+}
+
+static void number_to_float(float *dst, const lua_Number *src, int n) {
+  int i = 0;
+#if defined(XLUA_SIMD_SSE2) || defined(XLUA_SIMD_NEON)
+  if (sizeof(lua_Number) == sizeof(double)) {
+    const double *d = (const double *)src;
+    for (; i + 4 <= n; i += 4) {
+#if defined(XLUA_SIMD_SSE2)
+      __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(d + i));
+      __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(d + i + 2));
+      _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+#else
+      vst1q_f32(dst + i, vcvt_high_f32_f64(vcvt_f32_f64(vld1q_f64(d + i)), vld1q_f64(d + i + 2)));
+#endif
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (float)src[i];
+  }
+}
+
+// pushes a table of count CSharpStruct userdata with metatable meta_ref, element i holding the vector at src + i *
+// stride, returns 0 on bad arguments (nothing pushed)
+LUA_API int xlua_pushstructarray(lua_State *L, const void *src, int count, int components, int stride, int meta_ref) {
+  int i;
+  unsigned int size = components * sizeof(float);
+  if (!vector_args_ok(count, components, stride)) {
+    return 0;
+  }
+  lua_createtable(L, count, 0);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, meta_ref);
+  for (i = 0; i < count; i++) {
+    CSharpStruct *css = (CSharpStruct *)lua_newuserdata(L, size + sizeof(int) + sizeof(unsigned int));
+    css->fake_id = -1;
+    css->len = size;
+    xlua_memstats_udata(L, css, MEM_STRUCT);
+    vector_copy((float *)css->data, (const float *)((const char *)src + (size_t)i * stride), components);
+    lua_pushvalue(L, -2);
+    lua_setmetatable(L, -2);
+    lua_rawseti(L, -3, i + 1);
+  }
+  lua_pop(L, 1);
+  return 1;
+}
+
+// unpacks up to count CSharpStruct userdata (metatable meta_ref, at least components floats) from the table at idx
+// into dst, stops at the first element that is not one and returns how many were copied, so the caller can fall
+// back to the per-element path from there
+LUA_API int xlua_tostructarray(lua_State *L, int idx, void *dst, int count, int components, int stride, int meta_ref) {
+  int i;
+  unsigned int size = components * sizeof(float);
+  if (!vector_args_ok(count, components, stride) || !lua_istable(L, idx)) {
+    return 0;
+  }
+  if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+    idx = lua_gettop(L) + idx + 1;
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, meta_ref);
+  for (i = 0; i < count; i++) {
+    CSharpStruct *css;
+    lua_rawgeti(L, idx, i + 1);
+    // lua_touserdata also returns light userdata, which has no CSharpStruct header to read
+    if (lua_type(L, -1) != LUA_TUSERDATA) {
+      lua_pop(L, 1);
+      break;
+    }
+    css = (CSharpStruct *)lua_touserdata(L, -1);
+    if (css->fake_id != -1 || css->len < size || !lua_getmetatable(L, -1)) {
+      lua_pop(L, 1);
+      break;
+    }
+    if (!lua_rawequal(L, -1, -3)) {
+      lua_pop(L, 2);
+      break;
+    }
+    lua_pop(L, 2);
+    vector_copy((float *)((char *)dst + (size_t)i * stride), (const float *)css->data, components);
+  }
+  lua_pop(L, 1);
+  return i;
+}
+
+// pushes the count vectors at src as one flat table of count * components numbers
+LUA_API int xlua_pushfloatarray(lua_State *L, const void *src, int count, int components, int stride) {
+  float gathered[VECTOR_CHUNK * VECTOR_MAX_COMPONENTS];
+  lua_Number numbers[VECTOR_CHUNK * VECTOR_MAX_COMPONENTS];
+  int base, i, n;
+  if (!vector_args_ok(count, components, stride)) {
+    return 0;
+  }
+  lua_createtable(L, count * components, 0);
+  for (base = 0; base < count; base += VECTOR_CHUNK) {
+    int chunk = count - base < VECTOR_CHUNK ? count - base : VECTOR_CHUNK;
+    for (i = 0; i < chunk; i++) {
+      vector_copy(gathered + i * components, (const float *)((const char *)src + (size_t)(base + i) * stride),
+                  components);
+    }
+    n = chunk * components;
+    float_to_number(numbers, gathered, n);
+    for (i = 0; i < n; i++) {
+      lua_pushnumber(L, numbers[i]);
+      lua_rawseti(L, -2, base * components + i + 1);
+    }
+  }
+  return 1;
+}
+
+// reads up to count vectors from the flat number table at idx into dst, returns how many complete vectors were read
+LUA_API int xlua_tofloatarray(lua_State *L, int idx, void *dst, int count, int components, int stride) {
+  float scattered[VECTOR_CHUNK * VECTOR_MAX_COMPONENTS];
+  lua_Number numbers[VECTOR_CHUNK * VECTOR_MAX_COMPONENTS];
+  int base, i, n;
+  if (!vector_args_ok(count, components, stride) || !lua_istable(L, idx)) {
+    return 0;
+  }
+  if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+    idx = lua_gettop(L) + idx + 1;
+  }
+  for (base = 0; base < count; base += VECTOR_CHUNK) {
+    int chunk = count - base < VECTOR_CHUNK ? count - base : VECTOR_CHUNK;
+    n = chunk * components;
+    for (i = 0; i < n; i++) {
+      lua_rawgeti(L, idx, base * components + i + 1);
+      if (lua_type(L, -1) != LUA_TNUMBER) {
+        lua_pop(L, 1);
+        break;
+      }
+      numbers[i] = lua_tonumber(L, -1);
+      lua_pop(L, 1);
+    }
+    chunk = i / components;
+    number_to_float(scattered, numbers, chunk * components);
+    for (i = 0; i < chunk; i++) {
+      vector_copy((float *)((char *)dst + (size_t)(base + i) * stride), scattered + i * components, components);
+    }
+    if (chunk * components != n) {
+      return base + chunk;
+    }
+  }
+  return count;
+}
+
 LUA_API int xlua_is_eq_str(lua_State *L, int idx, const char *str, int str_len) {
   size_t lmsg;
   const char *msg;
@@ -1045,6 +2124,32 @@ LUA_API int xlua_is_eq_str(lua_State *L, int idx, const char *str, int str_len)
   }
 }
 
+/*
+** string views: the bytes of a string value in place, valid while the value stays anchored (on the stack, in a table),
+** for C# to compare, hash or parse without a managed copy. The hash is 32 bit FNV-1a, not Lua's own (seeded per state
+** in 5.4, and not exposed), so C# can compute the same value for its keys up front; pass NULL to skip it. Only string
+** values give a view, numbers are not converted as lua_tolstring would do in place
+*/
+LUA_API const char *xlua_tostringview(lua_State *L, int idx, int *len, uint32_t *hash) {
+  size_t l;
+  const char *s;
+  if (lua_type(L, idx) != LUA_TSTRING) {
+    *len = 0;
+    return NULL;
+  }
+  s = lua_tolstring(L, idx, &l);
+  *len = (int)l;
+  if (hash != NULL) {
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < l; i++) {
+      h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    *hash = h;
+  }
+  return s;
+}
+
 #define T_INT8 0
 #define T_UINT8 1
 #define T_INT16 2
@@ -1147,25 +2252,258 @@ LUA_API int css_clone(lua_State *L) {
   to->fake_id = -1;
   to->len = from->len;
   memcpy(&(to->data[0]), &(from->data[0]), from->len);
+  xlua_memstats_udata(L, to, MEM_STRUCT);
   lua_getmetatable(L, 1);
   lua_setmetatable(L, -2);
   return 1;
 }
 
+/*
+** typed array: a primitive C# array (element tag T_INT8..T_DOUBLE) exposed to lua as userdata, elements are read and
+** written in C without calling back into C#. Either owns a copy of the elements, or is a view on memory the caller
+** keeps pinned until xlua_typedarray_detach.
+*/
+typedef struct {
+  int type;
+  unsigned int len;
+  void *data;  // points to the inline storage for copies
+} TypedArray;
+
+static const unsigned int typed_array_elem_size[10] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+
+static const char *typed_array_tname = "xlua.TypedArray";
+
+static int typedarray_index(lua_State *L);
+static int typedarray_newindex(lua_State *L);
+static int typedarray_len(lua_State *L);
+
+static TypedArray *typedarray_new(lua_State *L, int type, size_t extra) {
+  TypedArray *ta = (TypedArray *)lua_newuserdata(L, sizeof(TypedArray) + extra);
+  ta->type = type;
+  ta->len = 0;
+  ta->data = NULL;
+  xlua_memstats_udata(L, ta, MEM_TYPEDARRAY);
+  if (luaL_newmetatable(L, typed_array_tname)) {
+    lua_pushcfunction(L, typedarray_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, typedarray_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_pushcfunction(L, typedarray_len);
+    lua_setfield(L, -2, "__len");
+  }
+  lua_setmetatable(L, -2);
+  return ta;
+}
+
+// pushes a typed array owning a copy of len elements from src (zero filled when src is NULL), returns the elements
+LUA_API void *xlua_pushtypedarray(lua_State *L, int type, const void *src, unsigned int len) {
+  size_t size;
+  TypedArray *ta;
+  if (type < T_INT8 || type > T_DOUBLE) {
+    luaL_error(L, "unknow tag[%d]", type);
+    return NULL;
+  }
+  // the byte size must not wrap on 32 bit targets
+  if (len > (SIZE_MAX - sizeof(TypedArray)) / typed_array_elem_size[type]) {
+    luaL_error(L, "typed array too large: %f elements", (lua_Number)len);
+    return NULL;
+  }
+  size = (size_t)len * typed_array_elem_size[type];
+  ta = typedarray_new(L, type, size);
+  ta->len = len;
+  ta->data = ta + 1;
+  if (src != NULL) {
+    memcpy(ta->data, src, size);
+  } else {
+    memset(ta->data, 0, size);
+  }
+  return ta->data;
+}
+
+// pushes a typed array viewing memory owned by the caller, which must stay valid until xlua_typedarray_detach
+LUA_API void xlua_pushtypedarrayview(lua_State *L, int type, void *data, unsigned int len) {
+  TypedArray *ta;
+  if (type < T_INT8 || type > T_DOUBLE) {
+    luaL_error(L, "unknow tag[%d]", type);
+    return;
+  }
+  ta = typedarray_new(L, type, 0);
+  ta->len = len;
+  ta->data = data;
+}
+
+static TypedArray *to_typedarray(lua_State *L, int idx) {
+  TypedArray *ta = (TypedArray *)lua_touserdata(L, idx);
+  if (ta != NULL && lua_getmetatable(L, idx)) {
+    luaL_getmetatable(L, typed_array_tname);
+    if (!lua_rawequal(L, -1, -2)) {
+      ta = NULL;
+    }
+    lua_pop(L, 2);
+    return ta;
+  }
+  return NULL;
+}
+
+// returns the elements of the typed array at idx, or NULL if it is not one
+LUA_API void *xlua_totypedarray(lua_State *L, int idx, int *type, unsigned int *len) {
+  TypedArray *ta = to_typedarray(L, idx);
+  if (ta == NULL) {
+    return NULL;
+  }
+  *type = ta->type;
+  *len = ta->len;
+  return ta->data;
+}
+
+// copies up to len elements into dst, returns the number copied, -1 if idx is not a typed array of that type
+LUA_API int xlua_typedarray_copyto(lua_State *L, int idx, int type, void *dst, unsigned int len) {
+  TypedArray *ta = to_typedarray(L, idx);
+  if (ta == NULL || ta->type != type) {
+    return -1;
+  }
+  if (len > ta->len) {
+    len = ta->len;
+  }
+  memcpy(dst, ta->data, (size_t)len * typed_array_elem_size[type]);
+  return (int)len;
+}
+
+// a detached view reports length 0, call before unpinning the memory it views
+LUA_API void xlua_typedarray_detach(lua_State *L, int idx) {
+  TypedArray *ta = to_typedarray(L, idx);
+  if (ta != NULL && ta->data != (void *)(ta + 1)) {
+    ta->len = 0;
+    ta->data = NULL;
+  }
+}
+
+#define TYPED_ARRAY_GET(tag, type, push_func) \
+  case tag:                                   \
+    push_func(L, ((type *)ta->data)[i]);      \
+    break;
+
+#define TYPED_ARRAY_SET(tag, type, to_func)      \
+  case tag:                                      \
+    ((type *)ta->data)[i] = (type)to_func(L, 3); \
+    break;
+
+// param   --- [1]: typed array, [2]: index(0 based) or "Length"
+static int typedarray_index(lua_State *L) {
+  TypedArray *ta = (TypedArray *)lua_touserdata(L, 1);
+  lua_Number n;
+  unsigned int i;
+  if (lua_type(L, 2) != LUA_TNUMBER) {
+    if (xlua_is_eq_str(L, 2, "Length", 6)) {
+      lua_pushnumber(L, ta->len);
+      return 1;
+    }
+    return luaL_error(L, "typed array index must be a number");
+  }
+  n = lua_tonumber(L, 2);
+  // range check before the conversion, casting a negative, huge or NaN number to unsigned int is undefined
+  if (!(n >= 0 && n < ta->len) || (lua_Number)(i = (unsigned int)n) != n) {
+    return luaL_error(L, "index out of range: %s, length %d", lua_tostring(L, 2), (int)ta->len);
+  }
+  switch (ta->type) {
+    TYPED_ARRAY_GET(T_INT8, int8_t, lua_pushinteger)
+    TYPED_ARRAY_GET(T_UINT8, uint8_t, lua_pushinteger)
+    TYPED_ARRAY_GET(T_INT16, int16_t, lua_pushinteger)
+    TYPED_ARRAY_GET(T_UINT16, uint16_t, lua_pushinteger)
+    TYPED_ARRAY_GET(T_INT32, int32_t, lua_pushinteger)
+    TYPED_ARRAY_GET(T_UINT32, uint32_t, xlua_pushuint)
+    TYPED_ARRAY_GET(T_INT64, int64_t, lua_pushint64)
+    TYPED_ARRAY_GET(T_UINT64, uint64_t, lua_pushuint64)
+    TYPED_ARRAY_GET(T_FLOAT, float, lua_pushnumber)
+    TYPED_ARRAY_GET(T_DOUBLE, double, lua_pushnumber)
+  }
+  return 1;
+}
+
+// param   --- [1]: typed array, [2]: index(0 based), [3]: value
+static int typedarray_newindex(lua_State *L) {
+  TypedArray *ta = (TypedArray *)lua_touserdata(L, 1);
+  lua_Number n;
+  unsigned int i;
+  if (lua_type(L, 2) != LUA_TNUMBER) {
+    return luaL_error(L, "typed array index must be a number");
+  }
+  n = lua_tonumber(L, 2);
+  // range check before the conversion, casting a negative, huge or NaN number to unsigned int is undefined
+  if (!(n >= 0 && n < ta->len) || (lua_Number)(i = (unsigned int)n) != n) {
+    return luaL_error(L, "index out of range: %s, length %d", lua_tostring(L, 2), (int)ta->len);
+  }
+  switch (ta->type) {
+    TYPED_ARRAY_SET(T_INT8, int8_t, xlua_tointeger)
+    TYPED_ARRAY_SET(T_UINT8, uint8_t, xlua_tointeger)
+    TYPED_ARRAY_SET(T_INT16, int16_t, xlua_tointeger)
+    TYPED_ARRAY_SET(T_UINT16, uint16_t, xlua_tointeger)
+    TYPED_ARRAY_SET(T_INT32, int32_t, xlua_tointeger)
+    TYPED_ARRAY_SET(T_UINT32, uint32_t, xlua_touint)
+    TYPED_ARRAY_SET(T_INT64, int64_t, lua_toint64)
+    TYPED_ARRAY_SET(T_UINT64, uint64_t, lua_touint64)
+    TYPED_ARRAY_SET(T_FLOAT, float, lua_tonumber)
+    TYPED_ARRAY_SET(T_DOUBLE, double, lua_tonumber)
+  }
+  return 0;
+}
+
+static int typedarray_len(lua_State *L) {
+  TypedArray *ta = (TypedArray *)lua_touserdata(L, 1);
+  lua_pushnumber(L, ta->len);
+  return 1;
+}
+
+// param   --- [1]: tag(T_INT8..T_DOUBLE), [2]: length
+static int typedarray_create(lua_State *L) {
+  int type = xlua_tointeger(L, 1);
+  lua_Integer len = luaL_checkinteger(L, 2);
+  if (len < 0 || (uint64_t)len > UINT_MAX) {
+    return luaL_error(L, "invalid length %s", lua_tostring(L, 2));
+  }
+  xlua_pushtypedarray(L, type, NULL, (unsigned int)len);
+  return 1;
+}
+
 LUA_API void *xlua_gl(lua_State *L) { return G(L); }
 
-static const luaL_Reg xlualib[] = {
-    {"sethook", profiler_set_hook}, {"genaccessor", gen_css_access}, {"structclone", css_clone}, {NULL, NULL}};
+// param   --- [1]: reset(optional)
+// return  --- [1]: hits, [2]: misses
+static int indexer_cache_stats(lua_State *L) {
+  uint64_t hits, misses;
+  xlua_indexer_cache_stats(&hits, &misses, lua_toboolean(L, 1));
+  lua_pushnumber(L, (lua_Number)hits);
+  lua_pushnumber(L, (lua_Number)misses);
+  return 2;
+}
+
+extern int slab_alloc_stats(lua_State *L);
+extern int slab_mem_stats(lua_State *L);
+
+static const luaL_Reg xlualib[] = {{"sethook", profiler_set_hook},
+                                   {"genaccessor", gen_css_access},
+                                   {"structclone", css_clone},
+                                   {"indexercachestats", indexer_cache_stats},
+                                   {"typedarray", typedarray_create},
+                                   {"allocstats", slab_alloc_stats},
+                                   {"memstats", slab_mem_stats},
+                                   {NULL, NULL}};
 
 extern void luaopen_sidlrt(lua_State *L);
+extern void luaopen_profiler(lua_State *L);
 LUA_API void luaopen_xlua(lua_State *L) {
   luaL_openlibs(L);
 
 #if LUA_VERSION_NUM >= 503
   luaL_newlib(L, xlualib);
-  lua_setglobal(L, "xlua");
 #else
   luaL_register(L, "xlua", xlualib);
+#endif
+  luaopen_profiler(L);
+  lua_setfield(L, -2, "profiler");
+#if LUA_VERSION_NUM >= 503
+  lua_setglobal(L, "xlua");
+#else
   lua_pop(L, 1);
 #endif
 